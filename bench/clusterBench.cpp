@@ -0,0 +1,160 @@
+/**
+ * @file
+ * Benchmark of the cluster search, runnable without R. Generates a synthetic cell field (see syntheticImage.h)
+ * and times the stages of getClusters separately: seed sorting (with the bright mask), cluster expansion and
+ * output assembly, reporting the best of several repetitions as pixels/dots per second, along with the peak
+ * resident memory of the process and the counters of the search (see SearchStats).
+ *
+ * Usage: clusterBench [key=value]... with the keys rows, cols, density, diameter, diameterSd, donuts, noise,
+ * levels, seed (image), cutoff, width, var, minArea, threads, connectivity (4 or 8), acceptance (squared, euclidean,
+ * disk or gradient), tolerance (of the gradient acceptance) (search) and repeat.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+
+#include "syntheticImage.h"
+#include "clusterSearch.h"
+
+static double seconds(const std::chrono::steady_clock::time_point &start){
+  return std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+}
+
+/**
+ * @return the peak resident memory of the process in megabytes.
+ */
+static double peakMemory(){
+  struct rusage usage;
+  getrusage(RUSAGE_SELF,&usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss/1048576.0;
+#else
+  return usage.ru_maxrss/1024.0;
+#endif
+}
+
+int main(int argc, char **argv){
+  SyntheticParams image;
+  double cutoff=0.5;
+  double width=25;
+  double var=10;
+  double minArea=-1;
+  int threads=1;
+  int connectivity=4;
+  std::string acceptance="squared";
+  double tolerance=0;
+  int repeat=5;
+
+  for(int i=1;i<argc;i++){
+    const char *eq=strchr(argv[i],'=');
+    if(!eq){
+      fprintf(stderr,"expected key=value, got %s\n",argv[i]);
+      return 1;
+    }
+    const std::string key(argv[i],eq-argv[i]);
+    const double value=atof(eq+1);
+    if(key=="rows") image.nrow=(int)value;
+    else if(key=="cols") image.ncol=(int)value;
+    else if(key=="density") image.density=value;
+    else if(key=="diameter") image.diameter=value;
+    else if(key=="diameterSd") image.diameterSd=value;
+    else if(key=="donuts") image.donuts=value;
+    else if(key=="noise") image.noise=value;
+    else if(key=="levels") image.levels=(int)value;
+    else if(key=="seed") image.seed=(unsigned)value;
+    else if(key=="cutoff") cutoff=value;
+    else if(key=="width") width=value;
+    else if(key=="var") var=value;
+    else if(key=="minArea") minArea=value;
+    else if(key=="threads") threads=(int)value;
+    else if(key=="connectivity") connectivity=(int)value;
+    else if(key=="acceptance") acceptance=eq+1;
+    else if(key=="tolerance") tolerance=value;
+    else if(key=="repeat") repeat=std::max(1,(int)value);
+    else{
+      fprintf(stderr,"unknown key %s\n",key.c_str());
+      return 1;
+    }
+  }
+  //the get.clusters() default
+  if(minArea<0){
+    minArea=width-var/2;
+  }
+
+  std::vector<double> intensities;
+  const int cells=syntheticImage(image,intensities);
+  const double pixels=(double)image.nrow*image.ncol;
+  ClusterParams params(cutoff,width,var,minArea);
+  params.connectivity=connectivity;
+  params.gradientTolerance=tolerance;
+  if(acceptance=="squared") params.acceptance=ClusterParams::ACCEPT_SQUARED;
+  else if(acceptance=="euclidean") params.acceptance=ClusterParams::ACCEPT_EUCLIDEAN;
+  else if(acceptance=="disk") params.acceptance=ClusterParams::ACCEPT_DISK;
+  else if(acceptance=="gradient") params.acceptance=ClusterParams::ACCEPT_GRADIENT;
+  else{
+    fprintf(stderr,"unknown acceptance %s\n",acceptance.c_str());
+    return 1;
+  }
+  if(connectivity!=4&&connectivity!=8){
+    fprintf(stderr,"the connectivity must be 4 or 8\n");
+    return 1;
+  }
+  printf("image %dx%d, %d cells, search cutoff=%g width=%g var=%g minArea=%g threads=%d connectivity=%d "
+         "acceptance=%s\n",image.nrow,image.ncol,cells,cutoff,width,var,minArea,threads,connectivity,
+         acceptance.c_str());
+
+  double best[3]={1e300,1e300,1e300};
+  size_t clusterCount=0;
+  size_t seedCount=0;
+  for(int r=0;r<repeat;r++){
+    std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+    PixelField field(&intensities[0],image.nrow,image.ncol,cutoff);
+    std::vector<int> seeds;
+    sortSeeds(&intensities[0],image.nrow*image.ncol,cutoff,seeds);
+    best[0]=std::min(best[0],seconds(start));
+
+    start=std::chrono::steady_clock::now();
+    ClusterSet clusters;
+    findClusters(field,seeds,params,threads,clusters);
+    best[1]=std::min(best[1],seconds(start));
+
+    //the same work getClusters does for the flat (csr) output: image indices to 1-based coordinates
+    start=std::chrono::steady_clock::now();
+    toImageIndices(field,clusters);
+    std::vector<int> x(clusters.pixels.size());
+    std::vector<int> y(clusters.pixels.size());
+    for(size_t i=0;i<clusters.pixels.size();i++){
+      x[i]=clusters.pixels[i]%image.nrow+1;
+      y[i]=clusters.pixels[i]/image.nrow+1;
+    }
+    best[2]=std::min(best[2],seconds(start));
+
+    clusterCount=clusters.size();
+    seedCount=seeds.size();
+  }
+
+  //one more, untimed search for the counters of the expansion
+  PixelField field(&intensities[0],image.nrow,image.ncol,cutoff);
+  std::vector<int> seeds;
+  sortSeeds(&intensities[0],image.nrow*image.ncol,cutoff,seeds);
+  ClusterSet clusters;
+  SearchStats stats;
+  findClusters(field,seeds,params,threads,clusters,&stats);
+
+  const char *stages[3]={"seed sort","expansion","assembly"};
+  printf("%zu seeds, %zu clusters\n",seedCount,clusterCount);
+  for(int s=0;s<3;s++){
+    printf("%-10s %10.3f ms %12.1f Mpixels/s\n",stages[s],best[s]*1e3,pixels/best[s]/1e6);
+  }
+  const double total=best[0]+best[1]+best[2];
+  printf("%-10s %10.3f ms %12.1f Mpixels/s\n","total",total*1e3,pixels/total/1e6);
+  printf("%zu clusters grown, %zu too small, %zu too large, %zu pixels probed, %zu tested, %zu accepted, "
+         "peak stack depth %zu\n",stats.clustersGrown,stats.rejectedSmall,stats.rejectedLarge,stats.pixelsProbed,
+         stats.pixelsTested,stats.pixelsAccepted,stats.peakStackDepth);
+  printf("peak memory %.1f MB\n",peakMemory());
+  return 0;
+}
@@ -0,0 +1,51 @@
+#include <math.h>
+#include <random>
+#include <algorithm>
+
+#include "syntheticImage.h"
+
+int syntheticImage(const SyntheticParams &params, std::vector<double> &intensities){
+  std::mt19937 random(params.seed);
+  std::uniform_real_distribution<double> uniform(0,1);
+  std::normal_distribution<double> normal(0,1);
+
+  const size_t size=(size_t)params.nrow*params.ncol;
+  intensities.assign(size,0);
+  for(size_t i=0;i<size;i++){
+    intensities[i]=0.1+0.05*uniform(random);
+  }
+
+  const int cells=(int)(params.density*size/1e6+0.5);
+  for(int c=0;c<cells;c++){
+    const double cx=uniform(random)*params.nrow;
+    const double cy=uniform(random)*params.ncol;
+    const double radius=std::max(1.0,(params.diameter+params.diameterSd*normal(random))/2);
+    const double peak=0.6+0.4*uniform(random);
+    const bool donut=uniform(random)<params.donuts;
+    const int x0=std::max(0,(int)(cx-radius));
+    const int x1=std::min(params.nrow-1,(int)(cx+radius)+1);
+    const int y0=std::max(0,(int)(cy-radius));
+    const int y1=std::min(params.ncol-1,(int)(cy+radius)+1);
+    for(int y=y0;y<=y1;y++){
+      for(int x=x0;x<=x1;x++){
+        const double r=sqrt((x-cx)*(x-cx)+(y-cy)*(y-cy))/radius;
+        if(r<1){
+          //a soft disk, or a ring peaking half way out for the cells with a dim nucleus
+          const double profile=donut?1-fabs(r-0.5)*1.2:1-r*r*0.5;
+          double &v=intensities[x+(size_t)y*params.nrow];
+          v=std::max(v,peak*profile);
+        }
+      }
+    }
+  }
+
+  for(size_t i=0;i<size;i++){
+    double v=intensities[i]+params.noise*normal(random);
+    v=std::min(1.0,std::max(0.0,v));
+    if(params.levels>1){
+      v=floor(v*(params.levels-1)+0.5)/(params.levels-1);
+    }
+    intensities[i]=v;
+  }
+  return cells;
+}
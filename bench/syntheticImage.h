@@ -0,0 +1,55 @@
+/**
+ * @file
+ * Deterministic generator of synthetic cell fields for benchmarking the cluster search: bright round cells of
+ * varying diameter on a dark, noisy background, some of them with a dimmer (donut shaped) nucleus.
+ */
+#ifndef SYNTHETIC_IMAGE_H
+#define SYNTHETIC_IMAGE_H
+
+#include <vector>
+
+/**
+ * Parameters of a synthetic image.
+ */
+struct SyntheticParams {
+  int nrow;
+  int ncol;
+  /**
+   * number of cells per million pixels/dots.
+   */
+  double density;
+  /**
+   * mean cell diameter in pixels/dots.
+   */
+  double diameter;
+  /**
+   * standard deviation of the cell diameter.
+   */
+  double diameterSd;
+  /**
+   * fraction of the cells with a dim centre.
+   */
+  double donuts;
+  /**
+   * standard deviation of the background/signal noise.
+   */
+  double noise;
+  /**
+   * number of intensity levels the image is quantized to (256 for an 8 bit image), 0 for no quantization.
+   */
+  int levels;
+  unsigned seed;
+
+  SyntheticParams():nrow(2048),ncol(2048),density(400),diameter(25),diameterSd(4),donuts(0.3),noise(0.05),
+                    levels(256),seed(1){}
+};
+
+/**
+ * Generates a synthetic image, the same parameters always give the same image.
+ * @param params the image parameters.
+ * @param intensities receives the column-major intensities in [0,1], nrow*ncol values.
+ * @return the number of cells drawn.
+ */
+int syntheticImage(const SyntheticParams &params, std::vector<double> &intensities);
+
+#endif
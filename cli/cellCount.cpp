@@ -0,0 +1,220 @@
+/**
+ * @file
+ * Command-line cell counter, built on the plain C++ core of the package (libcellcount.a), no R needed. Clusters
+ * TIFF images with clusterBatch() (each image read and normalized to [0,1] as read.tiff() does) and writes, for
+ * every image, either the centres of its clusters or its label matrix, next to each other in the output directory.
+ *
+ * Usage: cellCount [key=value]... image.tif... with the keys cutoff, width, var, minArea, threads, connectivity
+ * (4 or 8), acceptance (squared, euclidean, disk or gradient), tolerance (of the gradient acceptance) (search),
+ * output (centres or labels), format (csv or binary), out (the output directory), overlay (png or tiff, to also
+ * write out/image.overlay.png or out/image.overlay.tif, see overlayImage.h), cache (a directory to keep the cache
+ * files of the images in, see imageCache.h) and batch (the number of images held in memory at once).
+ *
+ * The output of image.tif is out/image.centres.csv, out/image.labels.csv, out/image.centres.bin or
+ * out/image.labels.bin:
+ *  - centres.csv has a header and one line per cluster with the columns of get.clusters(output="centres"): X, Y,
+ *    area, mean.intensity and peak.intensity.
+ *  - labels.csv holds the label matrix of get.clusters(output="labels"), one line per image row.
+ *  - centres.bin holds the same five values per cluster as doubles, cluster after cluster, and labels.bin the
+ *    label matrix as column-major 32-bit integers, both without a header, in the byte order of the machine (as
+ *    R's writeBin() writes, readBin() reads them back).
+ * A line per image with its size and number of clusters is printed. The exit status is 1 if any image failed.
+ * Images of the same file name (without the extension) would write the same outputs, they are refused before
+ * anything is read.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "clusterBatch.h"
+#include "imageCache.h"
+
+/**
+ * @return the file name of the path without its directory and extension.
+ */
+static std::string stem(const std::string &path){
+  const size_t slash=path.find_last_of("/\\");
+  std::string name=slash==std::string::npos?path:path.substr(slash+1);
+  const size_t dot=name.find_last_of('.');
+  if(dot!=std::string::npos&&dot>0){
+    name.erase(dot);
+  }
+  return name;
+}
+
+static bool writeCentres(FILE *file, const ClusterSet &clusters, const bool binary){
+  if(!binary){
+    fprintf(file,"X,Y,area,mean.intensity,peak.intensity\n");
+  }
+  for(size_t i=0;i<clusters.summaries.size();i++){
+    const ClusterSummary &summary=clusters.summaries[i];
+    if(binary){
+      const double row[5]={summary.centreX(),summary.centreY(),(double)summary.area,summary.meanIntensity(),
+                           summary.peakIntensity};
+      if(fwrite(row,sizeof(double),5,file)!=5) return false;
+    }else{
+      fprintf(file,"%.15g,%.15g,%d,%.15g,%.15g\n",summary.centreX(),summary.centreY(),summary.area,
+              summary.meanIntensity(),summary.peakIntensity);
+    }
+  }
+  return true;
+}
+
+static bool writeLabels(FILE *file, const BatchResult &result, const bool binary){
+  const ClusterSet &clusters=result.clusters;
+  std::vector<int> labels((size_t)result.nrow*result.ncol,0);
+  for(size_t i=0;i<clusters.size();i++){
+    for(size_t j=clusters.offsets[i];j<clusters.offsets[i+1];j++){
+      labels[clusters.pixels[j]]=i+1;
+    }
+  }
+  if(binary){
+    return labels.empty()||fwrite(&labels[0],sizeof(int),labels.size(),file)==labels.size();
+  }
+  for(int x=0;x<result.nrow;x++){
+    for(int y=0;y<result.ncol;y++){
+      fprintf(file,y==0?"%d":",%d",labels[x+(size_t)y*result.nrow]);
+    }
+    fputc('\n',file);
+  }
+  return true;
+}
+
+int main(int argc, char **argv){
+  double cutoff=0.5;
+  double width=25;
+  double var=10;
+  double minArea=-1;
+  int threads=0;
+  int connectivity=4;
+  std::string acceptance="squared";
+  double tolerance=0;
+  std::string output="centres";
+  std::string format="csv";
+  std::string out=".";
+  std::string overlay;
+  std::string cache;
+  int batch=16;
+  std::vector<std::string> paths;
+
+  for(int i=1;i<argc;i++){
+    const char *eq=strchr(argv[i],'=');
+    if(!eq){
+      paths.push_back(argv[i]);
+      continue;
+    }
+    const std::string key(argv[i],eq-argv[i]);
+    const double value=atof(eq+1);
+    if(key=="cutoff") cutoff=value;
+    else if(key=="width") width=value;
+    else if(key=="var") var=value;
+    else if(key=="minArea") minArea=value;
+    else if(key=="threads") threads=(int)value;
+    else if(key=="connectivity") connectivity=(int)value;
+    else if(key=="acceptance") acceptance=eq+1;
+    else if(key=="tolerance") tolerance=value;
+    else if(key=="output") output=eq+1;
+    else if(key=="format") format=eq+1;
+    else if(key=="out") out=eq+1;
+    else if(key=="overlay") overlay=eq+1;
+    else if(key=="cache") cache=eq+1;
+    else if(key=="batch") batch=std::max(1,(int)value);
+    else{
+      fprintf(stderr,"unknown key %s\n",key.c_str());
+      return 1;
+    }
+  }
+  if(paths.empty()){
+    fprintf(stderr,"usage: cellCount [key=value]... image.tif...\n");
+    return 1;
+  }
+  //the get.clusters() default
+  if(minArea<0){
+    minArea=width-var/2;
+  }
+
+  ClusterParams params(cutoff,width,var,minArea);
+  params.connectivity=connectivity;
+  params.gradientTolerance=tolerance;
+  if(acceptance=="squared") params.acceptance=ClusterParams::ACCEPT_SQUARED;
+  else if(acceptance=="euclidean") params.acceptance=ClusterParams::ACCEPT_EUCLIDEAN;
+  else if(acceptance=="disk") params.acceptance=ClusterParams::ACCEPT_DISK;
+  else if(acceptance=="gradient") params.acceptance=ClusterParams::ACCEPT_GRADIENT;
+  else{
+    fprintf(stderr,"unknown acceptance %s\n",acceptance.c_str());
+    return 1;
+  }
+  if(connectivity!=4&&connectivity!=8){
+    fprintf(stderr,"the connectivity must be 4 or 8\n");
+    return 1;
+  }
+  if(output!="centres"&&output!="labels"){
+    fprintf(stderr,"unknown output %s\n",output.c_str());
+    return 1;
+  }
+  if(format!="csv"&&format!="binary"){
+    fprintf(stderr,"unknown format %s\n",format.c_str());
+    return 1;
+  }
+  if(!overlay.empty()&&overlay!="png"&&overlay!="tiff"){
+    fprintf(stderr,"unknown overlay %s\n",overlay.c_str());
+    return 1;
+  }
+  std::map<std::string,std::string> stems;
+  for(size_t i=0;i<paths.size();i++){
+    const std::string &other=stems.insert(std::make_pair(stem(paths[i]),paths[i])).first->second;
+    if(other!=paths[i]){
+      fprintf(stderr,"%s and %s would both be written to %s/%s.*\n",other.c_str(),paths[i].c_str(),out.c_str(),
+              stem(paths[i]).c_str());
+      return 1;
+    }
+  }
+  const bool centres=output=="centres";
+  const bool binary=format=="binary";
+
+  int failed=0;
+  std::vector<BatchImage> images;
+  std::vector<BatchResult> results;
+  for(size_t first=0;first<paths.size();first+=batch){
+    const size_t last=std::min(paths.size(),first+batch);
+    images.clear();
+    for(size_t i=first;i<last;i++){
+      images.push_back(BatchImage(paths[i]));
+      if(!cache.empty()){
+        images.back().cache=cacheFileName(cache,paths[i]);
+      }
+      if(!overlay.empty()){
+        images.back().overlay=out+"/"+stem(paths[i])+(overlay=="png"?".overlay.png":".overlay.tif");
+      }
+    }
+    //the centres need the summaries only, the labels the pixels/dots only
+    clusterBatch(images,params,threads,results,!centres,centres);
+
+    for(size_t i=0;i<results.size();i++){
+      const std::string &path=images[i].path;
+      if(!results[i].error.empty()){
+        fprintf(stderr,"%s: %s\n",path.c_str(),results[i].error.c_str());
+        failed++;
+        continue;
+      }
+      const std::string target=out+"/"+stem(path)+"."+output+(binary?".bin":".csv");
+      FILE *file=fopen(target.c_str(),binary?"wb":"w");
+      bool written=file!=0;
+      if(file){
+        written=centres?writeCentres(file,results[i].clusters,binary):writeLabels(file,results[i],binary);
+        written=fclose(file)==0&&written;
+      }
+      if(!written){
+        fprintf(stderr,"%s: cannot write %s\n",path.c_str(),target.c_str());
+        failed++;
+        continue;
+      }
+      printf("%s: %dx%d, %zu clusters\n",path.c_str(),results[i].nrow,results[i].ncol,results[i].clusters.size());
+    }
+    results.clear();
+  }
+  return failed>0?1:0;
+}
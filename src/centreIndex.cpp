@@ -0,0 +1,212 @@
+#include <Rcpp.h>
+#include <string>
+#include <vector>
+
+#include "spatialGrid.h"
+#include "workerPool.h"
+using namespace Rcpp;
+
+/**
+ * @return the index behind an external pointer, stops if it is gone (e.g. the pointer was saved and restored).
+ */
+static SpatialGrid &spatialGrid(SEXP index){
+  XPtr<SpatialGrid> grid(index);
+  if(!grid.get()){
+    stop("the centre index is no longer valid, build it again");
+  }
+  return *grid;
+}
+
+/**
+ * Stops unless all the values are finite, a NaN coordinate would fall in no bucket of the index.
+ * @param values the values.
+ * @param what what the values are, for the error message.
+ */
+static void checkFinite(const NumericVector &values, const std::string &what){
+  for(int i=0;i<values.size();i++){
+    if(!R_finite(values[i])){
+      stop(what+" must be finite");
+    }
+  }
+}
+
+/**
+ * Rcpp export function, builds a spatial index over points (cell centres).
+ * @param x the x coordinates of the points.
+ * @param y the y coordinates of the points.
+ * @param bucketSize side of a grid bucket, values not above 0 pick one holding two points on average.
+ * @return an external pointer to the index.
+ */
+// [[Rcpp::export]]
+RcppExport SEXP centreIndexBuild(SEXP x, SEXP y, SEXP bucketSize) {
+BEGIN_RCPP
+  const NumericVector xx(x);
+  const NumericVector yy(y);
+  if(xx.size()!=yy.size()){
+    stop("x and y must be of the same length");
+  }
+  checkFinite(xx, "the coordinates");
+  checkFinite(yy, "the coordinates");
+  XPtr<SpatialGrid> grid(new SpatialGrid(xx.begin(), yy.begin(), xx.size(), as<double>(bucketSize)), true);
+  return grid;
+END_RCPP
+}
+
+/**
+ * Rcpp export function, finds the indexed points within a distance of every query location.
+ * @param index the index (see centreIndexBuild).
+ * @param x the x coordinates of the query locations, or NULL to query the indexed points themselves.
+ * @param y the y coordinates of the query locations.
+ * @param radius the distance, one for all or one per location.
+ * @param countOnly whether to count the points only.
+ * @param nThreads number of threads to use, values below 1 mean as many as there are hardware threads.
+ * @return an integer vector of counts, or a List of 1-based point index vectors, one per location.
+ */
+// [[Rcpp::export]]
+RcppExport SEXP centreIndexRadius(SEXP index, SEXP x, SEXP y, SEXP radius, SEXP countOnly, SEXP nThreads) {
+BEGIN_RCPP
+  const SpatialGrid &grid=spatialGrid(index);
+  const bool self=Rf_isNull(x);
+  const NumericVector xx(self?NumericVector(0):NumericVector(x));
+  const NumericVector yy(self?NumericVector(0):NumericVector(y));
+  const NumericVector radiusV(radius);
+  const bool counts=as<bool>(countOnly);
+  const int count=self?grid.size():xx.size();
+  if(yy.size()!=xx.size()||(radiusV.size()!=1&&radiusV.size()!=count)){
+    stop("x, y and radius must be of the same length");
+  }
+  checkFinite(xx, "the query coordinates");
+  checkFinite(yy, "the query coordinates");
+  checkFinite(radiusV, "the radius");
+  
+  std::vector<int> found(counts?count:0);
+  std::vector<std::vector<int> > points(counts?0:count);
+  WorkerPool pool(std::min(resolveThreads(as<int>(nThreads)),std::max(1,count)));
+  pool.run(count,[&](const int, const int i){
+    const double r=radiusV[radiusV.size()==1?0:i];
+    const double qx=self?grid.x(i):xx[i];
+    const double qy=self?grid.y(i):yy[i];
+    if(counts){
+      found[i]=grid.radiusCount(qx,qy,r);
+    }else{
+      grid.radius(qx,qy,r,points[i]);
+    }
+  });
+  
+  if(counts){
+    return wrap(found);
+  }
+  List out(count);
+  for(int i=0;i<count;i++){
+    IntegerVector v(points[i].size());
+    for(size_t j=0;j<points[i].size();j++){
+      v[j]=points[i][j]+1;
+    }
+    out[i]=v;
+  }
+  return out;
+END_RCPP
+}
+
+/**
+ * Rcpp export function, finds the k nearest indexed points to every query location.
+ * @param index the index (see centreIndexBuild).
+ * @param x the x coordinates of the query locations, or NULL to query the indexed points themselves, in which
+ * case a point is not its own neighbor.
+ * @param y the y coordinates of the query locations.
+ * @param k number of neighbors.
+ * @param nThreads number of threads to use, values below 1 mean as many as there are hardware threads.
+ * @return a List of two length(x)*k matrices: the 1-based indices of the neighbors (index), nearest first, and
+ * the distances to them (dist).
+ */
+// [[Rcpp::export]]
+RcppExport SEXP centreIndexKnn(SEXP index, SEXP x, SEXP y, SEXP k, SEXP nThreads) {
+BEGIN_RCPP
+  const SpatialGrid &grid=spatialGrid(index);
+  const bool self=Rf_isNull(x);
+  const NumericVector xx(self?NumericVector(0):NumericVector(x));
+  const NumericVector yy(self?NumericVector(0):NumericVector(y));
+  const int kk=as<int>(k);
+  if(xx.size()!=yy.size()){
+    stop("x and y must be of the same length");
+  }
+  if(kk<1||kk>grid.size()-(self?1:0)){
+    stop("k must be between 1 and the number of points to search");
+  }
+  checkFinite(xx, "the query coordinates");
+  checkFinite(yy, "the query coordinates");
+  const int count=self?grid.size():xx.size();
+  
+  IntegerMatrix neighbors(count,kk);
+  NumericMatrix dist(count,kk);
+  int *neighborsOut=neighbors.begin();
+  double *distOut=dist.begin();
+  WorkerPool pool(std::min(resolveThreads(as<int>(nThreads)),std::max(1,count)));
+  pool.run(count,[&](const int, const int i){
+    std::vector<int> found(kk);
+    std::vector<double> d(kk);
+    if(self){
+      grid.nearest(grid.x(i),grid.y(i),kk,i,&found[0],&d[0]);
+    }else{
+      grid.nearest(xx[i],yy[i],kk,-1,&found[0],&d[0]);
+    }
+    for(int n=0;n<kk;n++){
+      neighborsOut[i+(size_t)n*count]=found[n]<0?NA_INTEGER:found[n]+1;
+      distOut[i+(size_t)n*count]=d[n];
+    }
+  });
+  return List::create(Named("index")=neighbors, Named("dist")=dist);
+END_RCPP
+}
+
+/**
+ * Rcpp export function, finds the indexed points in rectangular windows.
+ * @param index the index (see centreIndexBuild).
+ * @param x0 the lower x bounds of the windows.
+ * @param x1 the upper x bounds of the windows.
+ * @param y0 the lower y bounds of the windows.
+ * @param y1 the upper y bounds of the windows.
+ * @param countOnly whether to count the points only.
+ * @return an integer vector of counts, or a List of 1-based point index vectors, one per window.
+ */
+// [[Rcpp::export]]
+RcppExport SEXP centreIndexWindow(SEXP index, SEXP x0, SEXP x1, SEXP y0, SEXP y1, SEXP countOnly) {
+BEGIN_RCPP
+  const SpatialGrid &grid=spatialGrid(index);
+  const NumericVector x0V(x0);
+  const NumericVector x1V(x1);
+  const NumericVector y0V(y0);
+  const NumericVector y1V(y1);
+  const bool counts=as<bool>(countOnly);
+  const int count=x0V.size();
+  if(x1V.size()!=count||y0V.size()!=count||y1V.size()!=count){
+    stop("all the window bounds must be of the same length");
+  }
+  //infinite bounds leave a window open on that side, only NaN is rejected
+  for(int i=0;i<count;i++){
+    if(ISNAN(x0V[i])||ISNAN(x1V[i])||ISNAN(y0V[i])||ISNAN(y1V[i])){
+      stop("the window bounds must not be NA");
+    }
+  }
+  
+  IntegerVector found(counts?count:0);
+  List out(counts?0:count);
+  std::vector<int> points;
+  for(int i=0;i<count;i++){
+    grid.window(x0V[i],x1V[i],y0V[i],y1V[i],points);
+    if(counts){
+      found[i]=points.size();
+    }else{
+      IntegerVector v(points.size());
+      for(size_t j=0;j<points.size();j++){
+        v[j]=points[j]+1;
+      }
+      out[i]=v;
+    }
+  }
+  if(counts){
+    return found;
+  }
+  return out;
+END_RCPP
+}
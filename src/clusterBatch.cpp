@@ -0,0 +1,82 @@
+#include <new>
+#include <memory>
+#include <stdexcept>
+
+#include "clusterBatch.h"
+#include "imageCache.h"
+#include "overlayImage.h"
+#include "tiffImage.h"
+#include "workerPool.h"
+
+/**
+ * Takes a single image through all the stages of the search.
+ */
+static void clusterImage(const BatchImage &image, const ClusterParams &params, const int threads,
+                         const bool keepPixels, const bool summarize, const OverlayStyle &overlayStyle,
+                         BatchResult &result){
+  const double *intensities=image.intensities;
+  result.nrow=image.nrow;
+  result.ncol=image.ncol;
+  std::vector<double> decoded;
+  std::unique_ptr<CachedImage> cached;
+  if(!image.path.empty()&&!image.cache.empty()){
+    cached.reset(new CachedImage(image.path,image.cache,params.cutoff,true));
+    result.nrow=cached->nrow();
+    result.ncol=cached->ncol();
+    intensities=cached->intensities();
+  }else if(!image.path.empty()){
+    TiffImage tiff(image.path,true);
+    result.nrow=tiff.height();
+    result.ncol=tiff.width();
+    decoded.resize((size_t)result.nrow*result.ncol);
+    tiff.sumChannels(&decoded[0]);
+    normalizeIntensities(&decoded[0],decoded.size());
+    intensities=&decoded[0];
+  }
+  const bool overlay=!image.overlay.empty();
+  //the outlines of the overlay need the pixels/dots, they are dropped after it is rendered if not wanted
+  result.clusters.keepPixels=keepPixels||overlay;
+  result.clusters.summarize=summarize;
+  if(cached){
+    searchImage(intensities,result.nrow,result.ncol,cached->seeds(),cached->seedCount(),params,threads,
+                result.clusters);
+  }else{
+    searchImage(intensities,result.nrow,result.ncol,params,threads,result.clusters);
+  }
+  if(overlay){
+    std::vector<uint8_t> rgb;
+    renderOverlay(intensities,result.nrow,result.ncol,result.clusters,overlayStyle,rgb);
+    writeOverlay(image.overlay,rgb,result.ncol,result.nrow);
+    if(!keepPixels){
+      std::vector<int>().swap(result.clusters.pixels);
+      result.clusters.keepPixels=false;
+    }
+  }
+}
+
+void clusterBatch(const std::vector<BatchImage> &images, const ClusterParams &params, const int threads,
+                  std::vector<BatchResult> &results, const bool keepPixels, const bool summarize,
+                  const OverlayStyle &overlayStyle){
+  results.clear();
+  results.resize(images.size());
+  if(images.empty()){
+    return;
+  }
+
+  const int total=resolveThreads(threads);
+  const int workers=std::min(total,(int)images.size());
+  const int threadsPerImage=std::max(1,total/workers);
+
+  WorkerPool pool(workers);
+  pool.run(images.size(),[&](const int, const int i){
+    try{
+      clusterImage(images[i],params,threadsPerImage,keepPixels,summarize,overlayStyle,results[i]);
+    }catch(const std::bad_alloc &){
+      results[i].clusters.clear();
+      results[i].error="not enough memory";
+    }catch(const std::exception &e){
+      results[i].clusters.clear();
+      results[i].error=e.what();
+    }
+  });
+}
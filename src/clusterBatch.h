@@ -0,0 +1,80 @@
+/**
+ * @file
+ * Clusters a whole stack of images in one go. Plain C++, the images are processed on a pool of worker threads,
+ * each of them taking the next image through all the stages of the search (threshold, seed, cluster, summarize),
+ * so that different images are in different stages at the same time. Images given as file paths are decoded by
+ * the workers as well, and so are the overlays of the images that ask for one (see overlayImage.h) rendered.
+ */
+#ifndef CLUSTER_BATCH_H
+#define CLUSTER_BATCH_H
+
+#include <string>
+#include <vector>
+
+#include "clusterSearch.h"
+#include "overlayImage.h"
+
+/**
+ * An image to be clustered in a batch.
+ */
+struct BatchImage {
+  /**
+   * column-major image intensities, nrow*ncol values, must stay valid for the whole batch. Null if the image
+   * is to be read from a file.
+   */
+  const double *intensities;
+  int nrow;
+  int ncol;
+  /**
+   * path to a TIFF file the image is read (and normalized) from by the worker processing it, empty if the
+   * intensities are given.
+   */
+  std::string path;
+  /**
+   * path to the PNG or TIFF file the overlay of the clusters is written to (see writeOverlay()), empty for none.
+   */
+  std::string overlay;
+  /**
+   * path to the cache file (see CachedImage) the image is preprocessed into on the first run and read back from
+   * on the later ones, empty for none. Only used for images read from a file.
+   */
+  std::string cache;
+  BatchImage(const double *intensities, const int nrow, const int ncol)
+    :intensities(intensities),nrow(nrow),ncol(ncol){}
+  explicit BatchImage(const std::string &path)
+    :intensities(0),nrow(0),ncol(0),path(path){}
+};
+
+/**
+ * The outcome of clustering one image of a batch.
+ */
+struct BatchResult {
+  int nrow;
+  int ncol;
+  /**
+   * the clusters, the pixels/dots given as 0-based column-major image indices.
+   */
+  ClusterSet clusters;
+  /**
+   * empty if the image was processed, otherwise a description of what went wrong.
+   */
+  std::string error;
+  BatchResult():nrow(0),ncol(0){}
+};
+
+/**
+ * Clusters every image of the batch with the same parameters.
+ * @param images the images.
+ * @param params search parameters shared by all the images.
+ * @param threads the number of threads to use, values below 1 mean as many as there are hardware threads. If
+ * there are fewer images than threads, the spare threads are used to search the images in parallel.
+ * @param results receives one result per image, in the order of the images.
+ * @param keepPixels whether to keep the pixels/dots of the clusters (see ClusterSet::keepPixels).
+ * @param summarize whether to accumulate a ClusterSummary for every cluster (see ClusterSet::summarize).
+ * @param overlayStyle the colours and markers of the overlays.
+ */
+void clusterBatch(const std::vector<BatchImage> &images, const ClusterParams &params, const int threads,
+                  std::vector<BatchResult> &results, const bool keepPixels=true, const bool summarize=false,
+                  const OverlayStyle &overlayStyle=OverlayStyle());
+
+#endif
@@ -0,0 +1,84 @@
+#include "clusterCore.h"
+
+/**
+ * Number of buckets the seed intensities are distributed over before the final sort. The image is
+ * normalized to [0,1] (and typically comes from 8 or 16 bit channels), so most buckets end up holding
+ * a single distinct intensity value.
+ */
+static const int SEED_BUCKETS=4096;
+
+PixelField::PixelField(const double *intensities, const int nrow, const int ncol, const double cutoff)
+  :intensities_(intensities),nrow_(nrow),ncol_(ncol),stride_(nrow+2){
+  const size_t words=((size_t)stride_*(ncol+2)+63)/64;
+  brightBits_.assign(words,0);
+  visitedBits_.assign(words,0);
+  for(int y=1;y<=ncol;y++){
+    const double *column=intensities+(size_t)(y-1)*nrow;
+    for(int x=1;x<=nrow;x++){
+      const double intensity=column[x-1];
+      if(intensity>0&&intensity>=cutoff){
+        const int i=index(x,y);
+        brightBits_[i>>6]|=(uint64_t)1<<(i&63);
+      }
+    }
+  }
+}
+
+/**
+ * Orders image indices by the corresponding intensity descending.
+ */
+struct IntensityDescending {
+  const double *intensities;
+  IntensityDescending(const double *intensities):intensities(intensities){}
+  bool operator()(const int a, const int b) const {
+    return intensities[a]>intensities[b];
+  }
+};
+
+/**
+ * Collects the pixels/dots that may start a cluster (the bright enough ones) and sorts them by intensity
+ * descending. Pixels/dots of equal intensity keep their column-major order, so the seeds come out exactly as
+ * the former R-side melt() + order(decreasing = TRUE) step produced them, only without the background ones.
+ * The sort is a stable bucket (counting) sort over the intensity range, followed by a stable sort within
+ * each bucket.
+ */
+void sortSeeds(const double *intensities, const int size, const double cutoff, std::vector<int> &seeds){
+  std::vector<int> bright;
+  double low=0;
+  double high=0;
+  for(int i=0;i<size;i++){
+    const double intensity=intensities[i];
+    if(intensity>0&&intensity>=cutoff){
+      if(bright.empty()||intensity<low) low=intensity;
+      if(bright.empty()||intensity>high) high=intensity;
+      bright.push_back(i);
+    }
+  }
+
+  seeds.resize(bright.size());
+  if(bright.empty()){
+    return;
+  }
+
+  const double scale=high>low?(SEED_BUCKETS-1)/(high-low):0;
+  std::vector<int> bucketStart(SEED_BUCKETS+1,0);
+  for(size_t i=0;i<bright.size();i++){
+    const int bucket=std::min(SEED_BUCKETS-1,(int)((high-intensities[bright[i]])*scale));
+    bucketStart[bucket+1]++;
+  }
+  for(int b=0;b<SEED_BUCKETS;b++){
+    bucketStart[b+1]+=bucketStart[b];
+  }
+  std::vector<int> bucketFill(bucketStart.begin(),bucketStart.end()-1);
+  for(size_t i=0;i<bright.size();i++){
+    const int bucket=std::min(SEED_BUCKETS-1,(int)((high-intensities[bright[i]])*scale));
+    seeds[bucketFill[bucket]++]=bright[i];
+  }
+
+  const IntensityDescending descending(intensities);
+  for(int b=0;b<SEED_BUCKETS;b++){
+    if(bucketStart[b+1]-bucketStart[b]>1){
+      std::stable_sort(seeds.begin()+bucketStart[b],seeds.begin()+bucketStart[b+1],descending);
+    }
+  }
+}
@@ -0,0 +1,435 @@
+/**
+ * @file
+ * Plain C++ core of the cluster search (no R/Rcpp types), see getClusters.cpp for the algorithm description.
+ * Pixels/dots are addressed by their 1-based (x,y) coordinates in the image matrix, x being the row and y the
+ * column, or by a linear index into the padded field described below.
+ */
+#ifndef CLUSTER_CORE_H
+#define CLUSTER_CORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+/**
+ * Compact, cache-friendly representation of an image for the cluster search. Holds two bit masks, one bit per
+ * pixel/dot: the pixels that are bright enough (precomputed once for the cutoff) and the pixels that have been
+ * visited by an expanding cluster. The masks are column-major and padded with a one pixel wide border that is
+ * never bright, so that the neighbors of any pixel are reached by adding a constant to its linear index and the
+ * expansion needs no bounds checks. With the padding, a 1-based coordinate (x,y) maps to the linear index
+ * x+y*stride.
+ */
+class PixelField {
+public:
+  /**
+   * @param intensities column-major image intensities, nrow*ncol values, kept (not copied) for the cluster
+   * summaries, so they must outlive the field.
+   * @param nrow number of rows in the image.
+   * @param ncol number of columns in the image.
+   * @param cutoff background intensity cutoff, pixels/dots must be greater than 0 and not lower than the cutoff
+   * to be considered bright.
+   */
+  PixelField(const double *intensities, const int nrow, const int ncol, const double cutoff);
+
+  int nrow() const { return nrow_; }
+  int ncol() const { return ncol_; }
+  /**
+   * @return the distance between horizontally adjacent pixels/dots in the linear index (number of padded rows).
+   */
+  int stride() const { return stride_; }
+
+  /**
+   * @param x 1-based row coordinate.
+   * @param y 1-based column coordinate.
+   * @return the linear field index of (x,y).
+   */
+  int index(const int x, const int y) const { return x+y*stride_; }
+  /**
+   * @param imageIndex 0-based column-major index of a pixel/dot in the unpadded image.
+   * @return the linear field index of the same pixel/dot.
+   */
+  int fieldIndex(const int imageIndex) const { return index(imageIndex%nrow_+1,imageIndex/nrow_+1); }
+  /**
+   * @param index a linear field index (not on the border).
+   * @return 0-based column-major index of the same pixel/dot in the unpadded image.
+   */
+  int imageIndex(const int index) const { return (x(index)-1)+(y(index)-1)*nrow_; }
+  /**
+   * @return 1-based row coordinate of a field index.
+   */
+  int x(const int index) const { return index%stride_; }
+  /**
+   * @return 1-based column coordinate of a field index.
+   */
+  int y(const int index) const { return index/stride_; }
+  /**
+   * @return the column-major image intensities the field was made of.
+   */
+  const double *intensities() const { return intensities_; }
+
+  /**
+   * @return true if the pixel/dot is bright enough to be considered a part of a cell, the border never is.
+   */
+  bool bright(const int index) const { return testBit(brightBits_,index); }
+  /**
+   * @return true if the pixel/dot has been visited (potentially by another expanding cluster).
+   */
+  bool visited(const int index) const { return testBit(visitedBits_,index); }
+  /**
+   * @return true if the pixel/dot is bright enough and has not been visited yet.
+   */
+  bool available(const int index) const {
+    const int word=index>>6;
+    const uint64_t bit=(uint64_t)1<<(index&63);
+    return (brightBits_[word]&~visitedBits_[word]&bit)!=0;
+  }
+  /**
+   * Marks the pixel/dot as visited.
+   */
+  void setVisited(const int index) { visitedBits_[index>>6]|=(uint64_t)1<<(index&63); }
+  /**
+   * Same as available(), but safe to call while other threads mark pixels/dots visited (see setVisitedShared()).
+   */
+  bool availableShared(const int index) const {
+    const int word=index>>6;
+    const uint64_t bit=(uint64_t)1<<(index&63);
+    return (brightBits_[word]&~__atomic_load_n(&visitedBits_[word],__ATOMIC_RELAXED)&bit)!=0;
+  }
+  /**
+   * Marks the pixel/dot as visited with an atomic update of its mask word, so that several threads may grow
+   * clusters at the same time as long as they never touch the same pixels/dots.
+   */
+  void setVisitedShared(const int index) {
+    __atomic_fetch_or(&visitedBits_[index>>6],(uint64_t)1<<(index&63),__ATOMIC_RELAXED);
+  }
+  /**
+   * Changes whether the pixel/dot is bright enough, for a new cutoff.
+   */
+  void setBright(const int index, const bool bright) {
+    const uint64_t bit=(uint64_t)1<<(index&63);
+    if(bright) brightBits_[index>>6]|=bit; else brightBits_[index>>6]&=~bit;
+  }
+  /**
+   * Marks every pixel/dot as not visited.
+   */
+  void clearVisited() { std::fill(visitedBits_.begin(),visitedBits_.end(),0); }
+
+private:
+  static bool testBit(const std::vector<uint64_t> &bits, const int index) {
+    return ((bits[index>>6]>>(index&63))&1)!=0;
+  }
+
+  const double *intensities_;
+  int nrow_;
+  int ncol_;
+  int stride_;
+  std::vector<uint64_t> brightBits_;
+  std::vector<uint64_t> visitedBits_;
+};
+
+/**
+ * A frame of the explicit expansion stack: the field index of a pixel/dot, its offset from the starting
+ * pixel/dot and the index of the next neighbor direction to probe (see NEIGHBOR_DX, the connectivity means
+ * exhausted).
+ */
+struct ExpansionFrame {
+  int pos;
+  int dx;
+  int dy;
+  int direction;
+  ExpansionFrame(const int pos, const int dx, const int dy):pos(pos),dx(dx),dy(dy),direction(0){}
+};
+
+/**
+ * Sufficient statistics of a cluster, accumulated while it grows: its area, the sums of the pixel/dot offsets
+ * from the seed and the sum and maximum of the intensities. The centre estimate is the mean of the coordinates,
+ * which is the maximum likelihood estimate of the centre of a bivariate normal spot.
+ */
+struct ClusterSummary {
+  /**
+   * 1-based row coordinate of the seed.
+   */
+  int x;
+  /**
+   * 1-based column coordinate of the seed.
+   */
+  int y;
+  int area;
+  long long sumDx;
+  long long sumDy;
+  double sumIntensity;
+  double peakIntensity;
+
+  ClusterSummary():x(0),y(0),area(0),sumDx(0),sumDy(0),sumIntensity(0),peakIntensity(0){}
+
+  /**
+   * Resets the statistics to a cluster made of the seed only.
+   */
+  void start(const int seedX, const int seedY, const double intensity) {
+    x=seedX;
+    y=seedY;
+    area=1;
+    sumDx=0;
+    sumDy=0;
+    sumIntensity=intensity;
+    peakIntensity=intensity;
+  }
+  /**
+   * Adds a pixel/dot at the given offset from the seed.
+   */
+  void add(const int dx, const int dy, const double intensity) {
+    area++;
+    sumDx+=dx;
+    sumDy+=dy;
+    sumIntensity+=intensity;
+    if(intensity>peakIntensity) peakIntensity=intensity;
+  }
+  /**
+   * @return 1-based row coordinate of the centre.
+   */
+  double centreX() const { return x+(double)sumDx/area; }
+  /**
+   * @return 1-based column coordinate of the centre.
+   */
+  double centreY() const { return y+(double)sumDy/area; }
+  double meanIntensity() const { return sumIntensity/area; }
+};
+
+/**
+ * Checks of a pixel/dot is close (Euclidean distance) to the starting point (the brighest point in the cluster).
+ * @param squared the squared distance of the pixel/dot from the starting one.
+ * @param width a diameter of a cluster (cell)
+ * @param var variance value, which rougly estimates how much the cells may vary in diameter
+ * @return true if the given pixel/dot can be considered as a part of a cell, false if
+ * the pixel/dot lays outside the reasonable cell size.
+ */
+inline bool closeEnoughSquared(const double squared, const double width, const double var){
+  const double dist=sqrt(squared);
+  const double dist_var=dist+var/2;
+  const double radius=(width+var)/2;
+  return(dist_var<=radius);
+}
+
+/**
+ * Checks of a pixel/dot is close (Euclidean distance) to the starting point (the brighest point in the cluster).
+ * @param dx row offset of the pixel/dot from the starting one.
+ * @param dy column offset of the pixel/dot from the starting one.
+ * @see closeEnoughSquared() for the other parameters.
+ */
+inline bool closeEnough(const int dx, const int dy, const double width, const double var){
+  return closeEnoughSquared((double)dx*dx+(double)dy*dy,width,var);
+}
+
+/**
+ * @return the largest squared distance closeEnough() accepts, -1 if it accepts none. closeEnough() only ever
+ * sees integer squared distances and is monotonic in them, so comparing the squared distance with this limit
+ * gives exactly the same answers, rounding included.
+ */
+inline int maxSquaredDistance(const double width, const double var){
+  const double radius=std::max(0.0,width/2);
+  int limit=(int)std::min(radius*radius+2,(double)(1<<28));
+  while(limit>=0&&!closeEnoughSquared(limit,width,var)){
+    limit--;
+  }
+  return limit;
+}
+
+/**
+ * Acceptance policies of the expansion: decide whether a free neighbor joins the cluster, given its offset
+ * (dx,dy) from the seed and pointers to the intensities of the pixel/dot it is reached from and of its own. They
+ * are template arguments of growCluster(), so the test is inlined into the expansion loop.
+ */
+
+/**
+ * The original test, closeEnough() with its square root, kept as the reference.
+ */
+struct EuclideanAcceptance {
+  double width;
+  double var;
+  EuclideanAcceptance(const double width, const double var):width(width),var(var){}
+  bool accept(const int dx, const int dy, const double *, const double *) const {
+    return closeEnough(dx,dy,width,var);
+  }
+};
+
+/**
+ * The same test as a single integer comparison of the squared distance (see maxSquaredDistance()).
+ */
+struct SquaredAcceptance {
+  int maxSquared;
+  SquaredAcceptance(const double width, const double var):maxSquared(maxSquaredDistance(width,var)){}
+  bool accept(const int dx, const int dy, const double *, const double *) const {
+    return dx*dx+dy*dy<=maxSquared;
+  }
+};
+
+/**
+ * The same test as a look-up in a precomputed mask of the offsets, large enough for every offset the expansion
+ * can probe (one pixel/dot beyond the disk in each direction), so it needs no bounds checks.
+ */
+struct DiskAcceptance {
+  int side;
+  int centre;
+  std::vector<uint8_t> mask;
+  DiskAcceptance(const double width, const double var){
+    const int maxSquared=maxSquaredDistance(width,var);
+    const int reach=(maxSquared<0?0:(int)sqrt((double)maxSquared))+1;
+    side=2*reach+1;
+    centre=reach+reach*side;
+    mask.assign((size_t)side*side,0);
+    for(int dy=-reach;dy<=reach;dy++){
+      for(int dx=-reach;dx<=reach;dx++){
+        mask[centre+dx+dy*side]=dx*dx+dy*dy<=maxSquared;
+      }
+    }
+  }
+  bool accept(const int dx, const int dy, const double *, const double *) const {
+    return mask[centre+dx+dy*side]!=0;
+  }
+};
+
+/**
+ * The disk test plus an intensity gradient rule: a pixel/dot only joins if it is not brighter than the one it is
+ * reached from by more than a tolerance, so that a cluster grows downhill from its seed and stops in the valley
+ * between two touching cells.
+ */
+struct GradientAcceptance {
+  SquaredAcceptance disk;
+  double tolerance;
+  GradientAcceptance(const double width, const double var, const double tolerance)
+    :disk(width,var),tolerance(tolerance){}
+  bool accept(const int dx, const int dy, const double *from, const double *to) const {
+    return disk.accept(dx,dy,from,to)&&*to<=*from+tolerance;
+  }
+};
+
+/**
+ * Collects the pixels/dots that may start a cluster (the bright enough ones) and sorts them by intensity
+ * descending, pixels/dots of equal intensity keep their column-major order.
+ * @param intensities column-major image intensities.
+ * @param size number of pixels/dots in the image.
+ * @param cutoff background intensity cutoff.
+ * @param seeds a vector to be filled with the 0-based column-major image indices of the seeds.
+ */
+void sortSeeds(const double *intensities, const int size, const double cutoff, std::vector<int> &seeds);
+
+/**
+ * Neighbor offsets in the order the expansion probes them: right, up, left, down, which is all of them for
+ * 4-connectivity, and then the diagonals for 8-connectivity.
+ */
+static const int NEIGHBOR_DX[8]={1,0,-1,0,1,-1,-1,1};
+static const int NEIGHBOR_DY[8]={0,1,0,-1,1,1,-1,-1};
+
+/**
+ * Counters of a single expansion, for profiling (see SearchStats). Kept in locals while the cluster grows and
+ * written out once at the end, so they cost no more than an increment and a comparison per pixel/dot.
+ */
+struct ExpansionCounters {
+  /**
+   * the neighbors that were free (bright and not visited) and so were put to the acceptance test.
+   */
+  size_t tested;
+  /**
+   * the largest number of frames the expansion stack held.
+   */
+  size_t peakDepth;
+  ExpansionCounters():tested(0),peakDepth(0){}
+};
+
+/**
+ * Grows a single cluster from a seed pixel/dot. The expansion is depth-first and, with 4-connectivity, visits
+ * the neighbors in exactly the same order the former recursive checkNeighborhood/checkNeighbor pair did (right,
+ * up, left, down), but keeps its state in an explicit stack of frames instead of the C stack, so the depth
+ * of a cluster is only limited by the heap. Neighbors are reached by stepping the linear field index, the
+ * padded border is never bright, so no bounds checks are needed, and the offset from the seed is carried in
+ * the frame, so no coordinates have to be recovered from the index (the image index of a pixel/dot, needed to
+ * read its intensity, is the one of the seed shifted by the offset).
+ * @tparam Connectivity 4 or 8, the number of neighbors probed around each pixel/dot.
+ * @tparam Acceptance the acceptance policy (see EuclideanAcceptance and the others).
+ * @tparam Claims decides which pixels/dots are still free to take and records the ones taken, through
+ * available(index) and claim(index) (see VisitedClaims).
+ * @param field the image field, only its bright mask and geometry are used.
+ * @param claims the claims of the pixels/dots.
+ * @param acceptance the acceptance policy.
+ * @param seed field index of the starting pixel/dot (the brighest one in the cluster), must be free.
+ * @param stack a reusable work stack, cleared on entry.
+ * @param output a reusable vector, cleared on entry and filled with the field indices of the cluster
+ * pixels/dots in the order they were accepted.
+ * @param summary if not null, receives the statistics of the cluster, accumulated as the pixels/dots are accepted.
+ * @param counters if not null, receives the counters of the expansion. Every pixel/dot of the cluster probes all
+ * its neighbors, so the number of probes is the connectivity times the cluster size and is not counted.
+ */
+template<int Connectivity, class Acceptance, class Claims>
+void growCluster(const PixelField &field, Claims &claims, const Acceptance &acceptance, const int seed,
+                 std::vector<ExpansionFrame> &stack, std::vector<int> &output, ClusterSummary *summary,
+                 ExpansionCounters *counters=0){
+  int step[Connectivity];
+  for(int d=0;d<Connectivity;d++){
+    step[d]=NEIGHBOR_DX[d]+NEIGHBOR_DY[d]*field.stride();
+  }
+  const double *seedIntensity=field.intensities()+field.imageIndex(seed);
+  const int nrow=field.nrow();
+  size_t tested=0;
+  size_t peakDepth=1;
+
+  stack.clear();
+  output.clear();
+
+  claims.claim(seed);
+  if(summary) summary->start(field.x(seed),field.y(seed),*seedIntensity);
+  output.push_back(seed);
+  stack.push_back(ExpansionFrame(seed,0,0));
+
+  while(!stack.empty()){
+    ExpansionFrame &top=stack.back();
+    if(top.direction==Connectivity){
+      stack.pop_back();
+      continue;
+    }
+    const int direction=top.direction++;
+    const int pos=top.pos+step[direction];
+    const int dx=top.dx+NEIGHBOR_DX[direction];
+    const int dy=top.dy+NEIGHBOR_DY[direction];
+    //check if an adjasent pixel is bright enough, has not been visited and is within the possible range
+    if(!claims.available(pos)){
+      continue;
+    }
+    tested++;
+    if(acceptance.accept(dx,dy,seedIntensity+top.dx+(ptrdiff_t)top.dy*nrow,seedIntensity+dx+(ptrdiff_t)dy*nrow)){
+      claims.claim(pos);
+      output.push_back(pos);
+      if(summary) summary->add(dx,dy,seedIntensity[dx+(ptrdiff_t)dy*nrow]);
+      stack.push_back(ExpansionFrame(pos,dx,dy));
+      if(stack.size()>peakDepth) peakDepth=stack.size();
+    }
+  }
+  if(counters){
+    counters->tested=tested;
+    counters->peakDepth=peakDepth;
+  }
+}
+
+/**
+ * Claims pixels/dots by marking them visited in the field.
+ */
+struct VisitedClaims {
+  PixelField &field;
+  VisitedClaims(PixelField &field):field(field){}
+  bool available(const int index) const { return field.available(index); }
+  void claim(const int index) { field.setVisited(index); }
+};
+
+/**
+ * Claims pixels/dots by marking them visited with atomic updates (see PixelField::setVisitedShared()), so that
+ * clusters may be grown concurrently from seeds whose reachable areas do not overlap.
+ */
+struct SharedVisitedClaims {
+  PixelField &field;
+  SharedVisitedClaims(PixelField &field):field(field){}
+  bool available(const int index) const { return field.availableShared(index); }
+  void claim(const int index) { field.setVisitedShared(index); }
+};
+
+#endif
@@ -0,0 +1,267 @@
+#include "clusterSearch.h"
+#include "workerPool.h"
+
+/**
+ * Number of seeds that may grow their clusters concurrently in a round, per thread.
+ */
+static const int WINNERS_PER_THREAD=16;
+
+/**
+ * Upper bound on the number of seeds a round looks at, per seed that may grow. Many seeds of a bright cell are
+ * taken into a round before the cell is claimed, they all have to wait, but cost no more than a look-up.
+ */
+static const int SEEDS_PER_WINNER=64;
+
+/**
+ * A seed taken into a round of the parallel search.
+ */
+struct PendingSeed {
+  /**
+   * position of the seed in the sorted seed list.
+   */
+  int rank;
+  /**
+   * field index of the seed.
+   */
+  int pos;
+  int x;
+  int y;
+  PendingSeed(const int rank, const int pos, const int x, const int y):rank(rank),pos(pos),x(x),y(y){}
+};
+
+/**
+ * A grown cluster of acceptable size, waiting to be put in seed order.
+ */
+struct FoundCluster {
+  int rank;
+  size_t offset;
+  size_t size;
+  ClusterSummary summary;
+  FoundCluster(const int rank, const size_t offset, const size_t size, const ClusterSummary &summary)
+    :rank(rank),offset(offset),size(size),summary(summary){}
+  bool operator<(const FoundCluster &other) const { return rank<other.rank; }
+};
+
+template<int Connectivity, class Acceptance>
+static void findClustersSerial(PixelField &field, const int *seeds, const size_t seedCount,
+                               const ClusterParams &params, const Acceptance &acceptance, ClusterSet &clusters,
+                               SearchStats *stats){
+  VisitedClaims claims(field);
+  std::vector<ExpansionFrame> stack;
+  std::vector<int> output;
+  ClusterSummary summary;
+  ClusterSummary *summaryOut=clusters.summarize?&summary:0;
+  ExpansionCounters counters;
+  for(size_t i=0;i<seedCount;i++){
+    const int seed=field.fieldIndex(seeds[i]);
+    //check if the point has been visited
+    if(!field.visited(seed)){
+      growCluster<Connectivity>(field,claims,acceptance,seed,stack,output,summaryOut,stats?&counters:0);
+      if(stats) stats->addCluster(output.size(),counters,params);
+      if(params.acceptable(output.size())){
+        clusters.add(&output[0],&output[0]+output.size(),summary);
+      }
+    }
+  }
+}
+
+/**
+ * Tile grid of the seeds taken into the current round, each tile holding a list of the seeds in it, the most
+ * recently added first.
+ */
+class RoundTiles {
+public:
+  RoundTiles(const int nrow, const int ncol, const int side)
+    :side_(side),tilesX_(nrow/side+1),tilesY_(ncol/side+1),reach2_((long long)side*side),
+     heads_((size_t)tilesX_*tilesY_,-1){}
+
+  /**
+   * Adds a seed to its tile.
+   * @return true if no seed added before it lies within the reach (the tile side) of it.
+   */
+  bool add(const std::vector<PendingSeed> &round, const int entry){
+    const PendingSeed &seed=round[entry];
+    const int tx=seed.x/side_;
+    const int ty=seed.y/side_;
+    bool clear=true;
+    for(int i=std::max(0,tx-1);clear&&i<=std::min(tilesX_-1,tx+1);i++){
+      for(int j=std::max(0,ty-1);clear&&j<=std::min(tilesY_-1,ty+1);j++){
+        for(int k=heads_[i+(size_t)j*tilesX_];k!=-1;k=next_[k]){
+          const long long dx=round[k].x-seed.x;
+          const long long dy=round[k].y-seed.y;
+          if(dx*dx+dy*dy<=reach2_){
+            clear=false;
+            break;
+          }
+        }
+      }
+    }
+    const size_t tile=tx+(size_t)ty*tilesX_;
+    if(heads_[tile]==-1){
+      touched_.push_back(tile);
+    }
+    next_.push_back(heads_[tile]);
+    heads_[tile]=entry;
+    return clear;
+  }
+
+  /**
+   * Empties all the tiles for the next round.
+   */
+  void clear(){
+    for(size_t i=0;i<touched_.size();i++){
+      heads_[touched_[i]]=-1;
+    }
+    touched_.clear();
+    next_.clear();
+  }
+
+private:
+  int side_;
+  int tilesX_;
+  int tilesY_;
+  long long reach2_;
+  std::vector<int> heads_;
+  std::vector<int> next_;
+  std::vector<size_t> touched_;
+};
+
+template<int Connectivity, class Acceptance>
+static void findClustersParallel(PixelField &field, const int *seeds, const size_t seedCount,
+                                 const ClusterParams &params, const Acceptance &acceptance, const int threads,
+                                 ClusterSet &clusters, SearchStats *stats){
+  WorkerPool pool(threads);
+  const size_t maxWinners=(size_t)pool.size()*WINNERS_PER_THREAD;
+  const size_t maxRound=maxWinners*SEEDS_PER_WINNER;
+  RoundTiles tiles(field.nrow(),field.ncol(),std::max(1,(int)ceil(2*params.halo())));
+
+  std::vector<PendingSeed> round;
+  std::vector<PendingSeed> waiting;
+  std::vector<int> winners;
+  std::vector<std::vector<int> > grown;
+  std::vector<ClusterSummary> summaries;
+  std::vector<ExpansionCounters> counters;
+  std::vector<std::vector<ExpansionFrame> > stacks(pool.size());
+  std::vector<int> found;
+  std::vector<FoundCluster> foundClusters;
+
+  const WorkerPool::Task grow=[&](const int worker, const int i){
+    SharedVisitedClaims claims(field);
+    growCluster<Connectivity>(field,claims,acceptance,round[winners[i]].pos,stacks[worker],grown[i],
+                              clusters.summarize?&summaries[i]:0,stats?&counters[i]:0);
+  };
+
+  size_t next=0;
+  while(next<seedCount||!waiting.empty()){
+    //the seeds left over from the previous round come first, they all precede the ones not taken yet
+    round.clear();
+    winners.clear();
+    for(size_t i=0;i<waiting.size();i++){
+      if(!field.visited(waiting[i].pos)){
+        round.push_back(waiting[i]);
+        if(tiles.add(round,round.size()-1)){
+          winners.push_back(round.size()-1);
+        }
+      }
+    }
+    while(next<seedCount&&winners.size()<maxWinners&&round.size()<maxRound){
+      const int pos=field.fieldIndex(seeds[next]);
+      if(!field.visited(pos)){
+        round.push_back(PendingSeed(next,pos,field.x(pos),field.y(pos)));
+        if(tiles.add(round,round.size()-1)){
+          winners.push_back(round.size()-1);
+        }
+      }
+      next++;
+    }
+    tiles.clear();
+
+    if(grown.size()<winners.size()){
+      grown.resize(winners.size());
+      summaries.resize(winners.size());
+      counters.resize(winners.size());
+    }
+    pool.run(winners.size(),grow);
+
+    waiting.clear();
+    size_t w=0;
+    for(size_t i=0;i<round.size();i++){
+      if(w<winners.size()&&winners[w]==(int)i){
+        const std::vector<int> &cluster=grown[w];
+        if(stats) stats->addCluster(cluster.size(),counters[w],params);
+        if(params.acceptable(cluster.size())){
+          foundClusters.push_back(FoundCluster(round[i].rank,found.size(),cluster.size(),summaries[w]));
+          if(clusters.keepPixels){
+            found.insert(found.end(),cluster.begin(),cluster.end());
+          }
+        }
+        w++;
+      }else{
+        waiting.push_back(round[i]);
+      }
+    }
+  }
+
+  std::sort(foundClusters.begin(),foundClusters.end());
+  clusters.pixels.reserve(clusters.pixels.size()+found.size());
+  for(size_t i=0;i<foundClusters.size();i++){
+    if(clusters.keepPixels){
+      const int *begin=&found[0]+foundClusters[i].offset;
+      clusters.add(begin,begin+foundClusters[i].size,foundClusters[i].summary);
+    }else{
+      clusters.add(foundClusters[i].size,foundClusters[i].summary);
+    }
+  }
+}
+
+/**
+ * The search, specialized by dispatchKernel().
+ */
+struct SearchKernel {
+  PixelField &field;
+  const int *seeds;
+  size_t seedCount;
+  const ClusterParams &params;
+  int threads;
+  ClusterSet &clusters;
+  SearchStats *stats;
+  SearchKernel(PixelField &field, const int *seeds, const size_t seedCount, const ClusterParams &params,
+               const int threads, ClusterSet &clusters, SearchStats *stats)
+    :field(field),seeds(seeds),seedCount(seedCount),params(params),threads(threads),clusters(clusters),stats(stats){}
+
+  template<int Connectivity, class Acceptance>
+  void run(const Acceptance &acceptance){
+    if(resolveThreads(threads)>1){
+      findClustersParallel<Connectivity>(field,seeds,seedCount,params,acceptance,threads,clusters,stats);
+    }else{
+      findClustersSerial<Connectivity>(field,seeds,seedCount,params,acceptance,clusters,stats);
+    }
+  }
+};
+
+void findClusters(PixelField &field, const int *seeds, const size_t seedCount, const ClusterParams &params,
+                  const int threads, ClusterSet &clusters, SearchStats *stats){
+  if(stats) stats->seedsScanned+=seedCount;
+  SearchKernel kernel(field,seeds,seedCount,params,threads,clusters,stats);
+  dispatchKernel(params,kernel);
+}
+
+void searchImage(const double *intensities, const int nrow, const int ncol, const ClusterParams &params,
+                 const int threads, ClusterSet &clusters, SearchStats *stats){
+  std::vector<int> seeds;
+  sortSeeds(intensities,nrow*ncol,params.cutoff,seeds);
+  searchImage(intensities,nrow,ncol,seeds.empty()?0:&seeds[0],seeds.size(),params,threads,clusters,stats);
+}
+
+void searchImage(const double *intensities, const int nrow, const int ncol, const int *seeds, const size_t seedCount,
+                 const ClusterParams &params, const int threads, ClusterSet &clusters, SearchStats *stats){
+  PixelField field(intensities,nrow,ncol,params.cutoff);
+  findClusters(field,seeds,seedCount,params,threads,clusters,stats);
+  toImageIndices(field,clusters);
+}
+
+void toImageIndices(const PixelField &field, ClusterSet &clusters){
+  for(size_t i=0;i<clusters.pixels.size();i++){
+    clusters.pixels[i]=field.imageIndex(clusters.pixels[i]);
+  }
+}
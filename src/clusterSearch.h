@@ -0,0 +1,304 @@
+/**
+ * @file
+ * Runs the whole cluster search over a prepared PixelField, either serially or on several threads. Plain C++,
+ * see getClusters.cpp for the algorithm description.
+ */
+#ifndef CLUSTER_SEARCH_H
+#define CLUSTER_SEARCH_H
+
+#include <vector>
+#include <stddef.h>
+
+#include "clusterCore.h"
+
+/**
+ * Parameters of a cluster search, as given to get.clusters().
+ */
+struct ClusterParams {
+  /**
+   * the acceptance policies of the expansion (see EuclideanAcceptance and the others).
+   */
+  enum Acceptance { ACCEPT_SQUARED, ACCEPT_EUCLIDEAN, ACCEPT_DISK, ACCEPT_GRADIENT };
+
+  /**
+   * background intensity cutoff.
+   */
+  double cutoff;
+  /**
+   * a diameter of a cluster (cell).
+   */
+  double width;
+  /**
+   * variance value, which rougly estimates how much the cells may vary in diameter.
+   */
+  double var;
+  /**
+   * is used if its value is lower than the area implied by width-var, that is, if the cells vary in size so
+   * drastically (in case of ischemic shock for instance), that very small cells along with normal large cells
+   * must be considered for counting.
+   */
+  double minArea;
+  /**
+   * 4 or 8, the number of neighbors a cluster grows to around each of its pixels/dots.
+   */
+  int connectivity;
+  /**
+   * how the expansion decides whether a neighbor joins a cluster, the distance tests all give the same clusters.
+   */
+  Acceptance acceptance;
+  /**
+   * how much brighter than the pixel/dot it is reached from a neighbor may be, for ACCEPT_GRADIENT.
+   */
+  double gradientTolerance;
+
+  ClusterParams(const double cutoff, const double width, const double var, const double minArea)
+    :cutoff(cutoff),width(width),var(var),minArea(minArea),connectivity(4),acceptance(ACCEPT_SQUARED),
+     gradientTolerance(0){}
+
+  /**
+   * @return the expected area of a cell.
+   */
+  double area() const { return 3*pow(width/2,2); }
+  /**
+   * @return the smallest number of pixels/dots a cluster must have to be reported.
+   */
+  double minClusterSize() const {
+    const double lowMargin=3*pow((width-var)/2,2);
+    return lowMargin>minArea?minArea:lowMargin;
+  }
+  /**
+   * @return the largest number of pixels/dots a cluster may have to be reported.
+   */
+  double maxClusterSize() const { return 3*pow((width+var)/2,2); }
+  /**
+   * @return true if a cluster of the given number of pixels/dots is large (and small) enough to be a cell.
+   */
+  bool acceptable(const size_t size) const { return size<=maxClusterSize()&&size>=minClusterSize(); }
+  /**
+   * @return the halo of a seed: no pixel/dot further than this from a seed is ever read or changed while its
+   * cluster grows (the radius of a cluster is width/2, plus the ring of probed neighbors, one pixel/dot wide, or
+   * a diagonal step with 8-connectivity).
+   */
+  double halo() const {
+    const double ring=connectivity==8?sqrt(2.0):1;
+    return (width+var)/2>width/2?(width+var)/2+ring:width/2+ring;
+  }
+};
+
+/**
+ * Calls kernel.run<Connectivity>(acceptance) with the given connectivity and the acceptance policy picked by
+ * the parameters.
+ */
+template<int Connectivity, class Kernel>
+void dispatchAcceptance(const ClusterParams &params, Kernel &kernel){
+  switch(params.acceptance){
+  case ClusterParams::ACCEPT_EUCLIDEAN:
+    kernel.template run<Connectivity>(EuclideanAcceptance(params.width,params.var));
+    break;
+  case ClusterParams::ACCEPT_DISK:
+    kernel.template run<Connectivity>(DiskAcceptance(params.width,params.var));
+    break;
+  case ClusterParams::ACCEPT_GRADIENT:
+    kernel.template run<Connectivity>(GradientAcceptance(params.width,params.var,params.gradientTolerance));
+    break;
+  default:
+    kernel.template run<Connectivity>(SquaredAcceptance(params.width,params.var));
+    break;
+  }
+}
+
+/**
+ * Calls kernel.run<Connectivity>(acceptance) with the connectivity and the acceptance policy picked by the
+ * parameters, so that the expansion loop (see growCluster()) is compiled for every combination and the choice
+ * is made once per search, not per pixel/dot.
+ * @param params search parameters.
+ * @param kernel an object with a member template<int Connectivity, class Acceptance> void run(const Acceptance&).
+ */
+template<class Kernel>
+void dispatchKernel(const ClusterParams &params, Kernel &kernel){
+  if(params.connectivity==8){
+    dispatchAcceptance<8>(params,kernel);
+  }else{
+    dispatchAcceptance<4>(params,kernel);
+  }
+}
+
+/**
+ * The clusters found by a search, in the order of their seeds (brightest first). The field indices of all
+ * pixels/dots are kept in one flat vector, cluster i occupying [offsets[i],offsets[i+1]). If only the summaries
+ * are wanted, the pixels/dots are not kept at all, the offsets still give the cluster sizes.
+ * @tparam Summary the statistics accumulated per cluster (ClusterSummary, or VolumeSummary for z-stacks).
+ */
+template<class Summary>
+struct BasicClusterSet {
+  std::vector<int> pixels;
+  std::vector<size_t> offsets;
+  /**
+   * one summary per cluster, filled only if summarize is set.
+   */
+  std::vector<Summary> summaries;
+  /**
+   * whether the pixels/dots of the clusters are kept.
+   */
+  bool keepPixels;
+  /**
+   * whether the search accumulates a Summary for every cluster.
+   */
+  bool summarize;
+
+  BasicClusterSet():offsets(1,0),keepPixels(true),summarize(false){}
+
+  /**
+   * @return the number of clusters.
+   */
+  size_t size() const { return offsets.size()-1; }
+  /**
+   * @return the number of pixels/dots in cluster i.
+   */
+  size_t clusterSize(const size_t i) const { return offsets[i+1]-offsets[i]; }
+  /**
+   * Appends a cluster.
+   */
+  void add(const int *begin, const int *end) {
+    if(keepPixels) pixels.insert(pixels.end(),begin,end);
+    offsets.push_back(offsets.back()+(end-begin));
+  }
+  /**
+   * Appends a cluster along with its summary.
+   */
+  void add(const int *begin, const int *end, const Summary &summary) {
+    add(begin,end);
+    if(summarize) summaries.push_back(summary);
+  }
+  /**
+   * Appends a cluster of which the pixels/dots are not kept.
+   */
+  void add(const size_t size, const Summary &summary) {
+    offsets.push_back(offsets.back()+size);
+    if(summarize) summaries.push_back(summary);
+  }
+  void clear() { pixels.clear(); offsets.assign(1,0); summaries.clear(); }
+};
+
+typedef BasicClusterSet<ClusterSummary> ClusterSet;
+
+/**
+ * Counters of a whole search, for profiling production runs: what the search looked at, what it grew and why
+ * clusters were dropped. Filled only if asked for, the counting itself is cheap (see ExpansionCounters).
+ */
+struct SearchStats {
+  /**
+   * the seeds looked at, taken or already visited.
+   */
+  size_t seedsScanned;
+  /**
+   * the seeds that grew a cluster (of any size).
+   */
+  size_t clustersGrown;
+  /**
+   * the neighbor probes of the grown clusters.
+   */
+  size_t pixelsProbed;
+  /**
+   * the probed neighbors that were free and put to the acceptance test.
+   */
+  size_t pixelsTested;
+  /**
+   * the pixels/dots taken by the grown clusters, seeds included.
+   */
+  size_t pixelsAccepted;
+  size_t clustersKept;
+  /**
+   * clusters dropped for being smaller than ClusterParams::minClusterSize().
+   */
+  size_t rejectedSmall;
+  /**
+   * clusters dropped for being larger than ClusterParams::maxClusterSize().
+   */
+  size_t rejectedLarge;
+  /**
+   * the largest number of frames the expansion stack of any cluster held.
+   */
+  size_t peakStackDepth;
+
+  SearchStats():seedsScanned(0),clustersGrown(0),pixelsProbed(0),pixelsTested(0),pixelsAccepted(0),clustersKept(0),
+                rejectedSmall(0),rejectedLarge(0),peakStackDepth(0){}
+
+  /**
+   * Counts a grown cluster.
+   * @param size the number of pixels/dots in the cluster.
+   * @param counters the counters of its expansion.
+   * @param params search parameters, to tell why a cluster was dropped.
+   */
+  void addCluster(const size_t size, const ExpansionCounters &counters, const ClusterParams &params) {
+    clustersGrown++;
+    pixelsProbed+=size*params.connectivity;
+    pixelsTested+=counters.tested;
+    pixelsAccepted+=size;
+    if(size>params.maxClusterSize()) rejectedLarge++;
+    else if(size<params.minClusterSize()) rejectedSmall++;
+    else clustersKept++;
+    if(counters.peakDepth>peakStackDepth) peakStackDepth=counters.peakDepth;
+  }
+};
+
+/**
+ * Grows clusters from the seeds in order and collects those of acceptable size.
+ *
+ * With more than one thread the search uses deterministic reservations: the image is covered by square tiles
+ * with a side of two halos (see ClusterParams::halo()), and the seeds are taken in rounds, in order. Within a
+ * round, a seed may grow its cluster only if no earlier seed of the round lies within two halos of it, which
+ * only needs a look at the seeds in the 3x3 neighboring tiles. Such clusters can not interfere with each other
+ * nor with any earlier, still pending seed, so they are grown concurrently, while the other seeds wait for the
+ * next round. The clusters are identical to (and reported in the same order as) those of the serial search.
+ *
+ * The expansion is specialized for the connectivity and the acceptance policy of the parameters (see
+ * dispatchKernel()).
+ * @param field the image field, the pixels/dots already visited count as taken (by an earlier search).
+ * @param seeds 0-based column-major image indices of the seeds, sorted by intensity descending (see sortSeeds()),
+ * all of them bright in the field.
+ * @param params search parameters.
+ * @param threads the number of threads to use, values below 1 mean as many as there are hardware threads.
+ * @param seedCount the number of seeds.
+ * @param clusters receives the clusters (and their summaries, if it is set to summarize).
+ * @param stats if not null, the counters of the search are added to it.
+ */
+void findClusters(PixelField &field, const int *seeds, const size_t seedCount, const ClusterParams &params,
+                  const int threads, ClusterSet &clusters, SearchStats *stats=0);
+
+inline void findClusters(PixelField &field, const std::vector<int> &seeds, const ClusterParams &params,
+                         const int threads, ClusterSet &clusters, SearchStats *stats=0){
+  findClusters(field,seeds.empty()?0:&seeds[0],seeds.size(),params,threads,clusters,stats);
+}
+
+/**
+ * Runs the whole search over an image in one call: builds the field, sorts the seeds, grows the clusters and
+ * converts them to image indices. This is the entry point for callers outside R (see cli/cellCount.cpp).
+ * @param intensities column-major image intensities, nrow*ncol values.
+ * @param nrow number of rows in the image.
+ * @param ncol number of columns in the image.
+ * @param params search parameters.
+ * @param threads the number of threads to use, values below 1 mean as many as there are hardware threads.
+ * @param clusters receives the clusters, the pixels/dots given as 0-based column-major image indices.
+ * @param stats if not null, the counters of the search are added to it.
+ */
+void searchImage(const double *intensities, const int nrow, const int ncol, const ClusterParams &params,
+                 const int threads, ClusterSet &clusters, SearchStats *stats=0);
+
+/**
+ * Runs the whole search over an image of which the seeds are already sorted (such as a CachedImage).
+ * @param seeds 0-based column-major image indices of the seeds, as sortSeeds() gives them.
+ * @param seedCount the number of seeds.
+ */
+void searchImage(const double *intensities, const int nrow, const int ncol, const int *seeds, const size_t seedCount,
+                 const ClusterParams &params, const int threads, ClusterSet &clusters, SearchStats *stats=0);
+
+/**
+ * Converts the pixels/dots of the clusters from field indices to 0-based column-major image indices, which
+ * do not depend on the field any more.
+ * @param field the field the clusters were found in.
+ * @param clusters the clusters to convert.
+ */
+void toImageIndices(const PixelField &field, ClusterSet &clusters);
+
+#endif
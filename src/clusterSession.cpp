@@ -0,0 +1,100 @@
+#include "getClusters.h"
+#include "incrementalSearch.h"
+
+/**
+ * @return the search behind an external pointer, stops if it is gone (e.g. the pointer was saved and restored).
+ */
+static IncrementalSearch &incrementalSearch(SEXP session){
+  XPtr<IncrementalSearch> search(session);
+  if(!search.get()){
+    stop("the cluster session is no longer valid, start it again");
+  }
+  return *search;
+}
+
+/**
+ * Wraps clusters of a session the way getClusters does, named after the (1-based) image index of their seeds.
+ */
+static List wrapSessionClusters(const IncrementalSearch &search, const std::vector<int> &ranks){
+  ClusterSet clusters;
+  CharacterVector names(ranks.size());
+  for(size_t i=0;i<ranks.size();i++){
+    const std::vector<int> pixels=search.clusterPixels(ranks[i]);
+    clusters.add(pixels.empty()?0:&pixels[0],pixels.empty()?0:&pixels[0]+pixels.size());
+    names[i]=std::to_string(search.rankPixel(ranks[i])+1);
+  }
+  List out=wrapClusters(clusters, search.nrow());
+  out.attr("names")=names;
+  return out;
+}
+
+/**
+ * Rcpp export function, starts a clustering session: copies the image and searches it (see getClusters), keeping
+ * the state needed to search it again with other cutoffs quickly.
+ * @param imgMtx an image intensity matrix.
+ * @param intensityCutoff background intensity cutoff.
+ * @param meanWidth a diameter of a cluster (cell).
+ * @param varWidth variance value, which rougly estimates how much the cells may vary in diameter
+ * @param minClusterArea see getClusters.
+ * @param kernel the expansion kernel (see readKernel()).
+ * @return an external pointer to the session.
+ */
+// [[Rcpp::export]]
+RcppExport SEXP clusterSessionStart(SEXP imgMtx, SEXP intensityCutoff, SEXP meanWidth, SEXP varWidth,
+                                    SEXP minClusterArea, SEXP kernel) {
+BEGIN_RCPP
+  const NumericMatrix img(imgMtx);
+  ClusterParams params(as<double>(intensityCutoff), as<double>(meanWidth), as<double>(varWidth),
+                       as<double>(minClusterArea));
+  readKernel(kernel, params);
+  XPtr<IncrementalSearch> search(new IncrementalSearch(img.begin(), img.nrow(), img.ncol(), params), true);
+  return search;
+END_RCPP
+}
+
+/**
+ * Rcpp export function, searches the image of a session again with another cutoff, re-growing only the clusters
+ * that may have changed (see incrementalSearch.h).
+ * @param session the session (see clusterSessionStart).
+ * @param intensityCutoff the new background intensity cutoff.
+ * @return a List of the clusters that were added, of the ones that changed (both named and shaped as in
+ * clusterSessionClusters) and of the names of the ones that were removed.
+ */
+// [[Rcpp::export]]
+RcppExport SEXP clusterSessionUpdate(SEXP session, SEXP intensityCutoff) {
+BEGIN_RCPP
+  IncrementalSearch &search=incrementalSearch(session);
+  std::vector<ClusterChange> changes;
+  const int replayed=search.setCutoff(as<double>(intensityCutoff), changes);
+  
+  std::vector<int> added;
+  std::vector<int> changed;
+  std::vector<std::string> removed;
+  for(size_t i=0;i<changes.size();i++){
+    if(changes[i].kind==ClusterChange::ADDED){
+      added.push_back(changes[i].rank);
+    }else if(changes[i].kind==ClusterChange::CHANGED){
+      changed.push_back(changes[i].rank);
+    }else{
+      removed.push_back(std::to_string(search.rankPixel(changes[i].rank)+1));
+    }
+  }
+  return List::create(Named("added")=wrapSessionClusters(search, added),
+                      Named("changed")=wrapSessionClusters(search, changed),
+                      Named("removed")=wrap(removed), Named("replayed")=wrap(replayed));
+END_RCPP
+}
+
+/**
+ * Rcpp export function, lists the current clusters of a session.
+ * @param session the session (see clusterSessionStart).
+ * @return the List of cluster coordinate matrices, exactly as getClusters returns it for the current cutoff, but
+ * named after the (1-based) image index of the seed of every cluster.
+ */
+// [[Rcpp::export]]
+RcppExport SEXP clusterSessionClusters(SEXP session) {
+BEGIN_RCPP
+  const IncrementalSearch &search=incrementalSearch(session);
+  return wrapSessionClusters(search, search.reportedRanks());
+END_RCPP
+}
@@ -0,0 +1,131 @@
+#include "clusterSweep.h"
+#include "workerPool.h"
+
+/**
+ * Parameter sets sharing a search: the same cutoff, width and var.
+ */
+struct SweepGroup {
+  /**
+   * index of the bright mask of the cutoff.
+   */
+  int field;
+  /**
+   * the parameter sets, as indices into the grid.
+   */
+  std::vector<int> members;
+};
+
+/**
+ * Orders parameter sets by cutoff, width, var and expansion kernel.
+ */
+struct SearchOrder {
+  const std::vector<ClusterParams> *grid;
+  SearchOrder(const std::vector<ClusterParams> *grid):grid(grid){}
+  bool operator()(const int a, const int b) const {
+    const ClusterParams &pa=(*grid)[a];
+    const ClusterParams &pb=(*grid)[b];
+    if(pa.cutoff!=pb.cutoff) return pa.cutoff<pb.cutoff;
+    if(pa.width!=pb.width) return pa.width<pb.width;
+    if(pa.var!=pb.var) return pa.var<pb.var;
+    if(pa.connectivity!=pb.connectivity) return pa.connectivity<pb.connectivity;
+    if(pa.acceptance!=pb.acceptance) return pa.acceptance<pb.acceptance;
+    return pa.gradientTolerance<pb.gradientTolerance;
+  }
+};
+
+/**
+ * Orders seeds (image indices) by their intensity not being lower than a cutoff, for finding where the seeds of
+ * the cutoff end.
+ */
+struct AtLeast {
+  const double *intensities;
+  double cutoff;
+  AtLeast(const double *intensities, const double cutoff):intensities(intensities),cutoff(cutoff){}
+  bool operator()(const int seed) const { return intensities[seed]>=cutoff; }
+};
+
+/**
+ * @return the bin of a cluster area, -1 if it is outside all the bins.
+ */
+static int areaBin(const std::vector<double> &breaks, const double area){
+  if(breaks.size()<2||area<breaks.front()||area>breaks.back()){
+    return -1;
+  }
+  const int bin=(int)(std::lower_bound(breaks.begin(),breaks.end(),area)-breaks.begin())-1;
+  return std::max(0,bin);
+}
+
+void clusterSweep(const double *intensities, const int nrow, const int ncol, const std::vector<ClusterParams> &grid,
+                  const std::vector<double> &breaks, const int threads, std::vector<SweepResult> &results){
+  results.clear();
+  results.resize(grid.size());
+  if(grid.empty()){
+    return;
+  }
+
+  std::vector<int> order(grid.size());
+  for(size_t i=0;i<order.size();i++){
+    order[i]=i;
+  }
+  std::sort(order.begin(),order.end(),SearchOrder(&grid));
+
+  std::vector<double> cutoffs;
+  std::vector<SweepGroup> groups;
+  for(size_t i=0;i<order.size();i++){
+    const ClusterParams &params=grid[order[i]];
+    if(cutoffs.empty()||params.cutoff!=cutoffs.back()){
+      cutoffs.push_back(params.cutoff);
+    }
+    if(groups.empty()||SearchOrder(&grid)(groups.back().members.back(),order[i])){
+      groups.push_back(SweepGroup());
+      groups.back().field=cutoffs.size()-1;
+    }
+    groups.back().members.push_back(order[i]);
+  }
+
+  //the seeds of the lowest cutoff, every other cutoff takes the ones at least as bright as it off the front
+  std::vector<int> seeds;
+  sortSeeds(intensities,nrow*ncol,cutoffs.front(),seeds);
+
+  const int total=resolveThreads(threads);
+  const int workers=std::min(total,(int)groups.size());
+  const int threadsPerGroup=std::max(1,total/workers);
+  WorkerPool pool(workers);
+
+  std::vector<PixelField> fields(cutoffs.size(),PixelField(0,0,0,0));
+  pool.run(cutoffs.size(),[&](const int, const int i){
+    fields[i]=PixelField(intensities,nrow,ncol,cutoffs[i]);
+  });
+
+  pool.run(groups.size(),[&](const int, const int g){
+    const SweepGroup &group=groups[g];
+    const double cutoff=cutoffs[group.field];
+    const size_t seedCount=std::partition_point(seeds.begin(),seeds.end(),AtLeast(intensities,cutoff))-seeds.begin();
+
+    //a single search with the most permissive minimum area of the group serves all of its members
+    ClusterParams params=grid[group.members[0]];
+    for(size_t m=1;m<group.members.size();m++){
+      params.minArea=std::min(params.minArea,grid[group.members[m]].minArea);
+    }
+    PixelField field(fields[group.field]);
+    ClusterSet clusters;
+    clusters.keepPixels=false;
+    findClusters(field,seeds.empty()?0:&seeds[0],seedCount,params,threadsPerGroup,clusters);
+
+    for(size_t m=0;m<group.members.size();m++){
+      const ClusterParams &memberParams=grid[group.members[m]];
+      SweepResult &result=results[group.members[m]];
+      result.histogram.assign(breaks.size()>1?breaks.size()-1:0,0);
+      for(size_t i=0;i<clusters.size();i++){
+        const size_t area=clusters.clusterSize(i);
+        if(memberParams.acceptable(area)){
+          result.count++;
+          const int bin=areaBin(breaks,area);
+          if(bin>=0){
+            result.histogram[bin]++;
+          }
+        }
+      }
+    }
+  });
+}
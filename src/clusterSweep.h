@@ -0,0 +1,45 @@
+/**
+ * @file
+ * Evaluates a whole grid of search parameters on a single image. Plain C++. The image is thresholded and its
+ * seeds are sorted only once: the seeds sorted for the lowest cutoff of the grid start with the seeds of every
+ * higher cutoff (the seeds for a cutoff are exactly the ones at least as bright as it), and the bright masks are
+ * built once per distinct cutoff. Parameter sets differing in the minimum cluster area only are served by a
+ * single search, and the distinct searches run in parallel.
+ */
+#ifndef CLUSTER_SWEEP_H
+#define CLUSTER_SWEEP_H
+
+#include <vector>
+
+#include "clusterSearch.h"
+
+/**
+ * The outcome of a search with one parameter set of a sweep.
+ */
+struct SweepResult {
+  /**
+   * number of clusters found.
+   */
+  int count;
+  /**
+   * number of clusters per area bin, see clusterSweep().
+   */
+  std::vector<int> histogram;
+  SweepResult():count(0){}
+};
+
+/**
+ * Searches an image with every parameter set of a grid.
+ * @param intensities column-major image intensities, nrow*ncol values.
+ * @param nrow number of rows in the image.
+ * @param ncol number of columns in the image.
+ * @param grid the parameter sets.
+ * @param breaks ascending area bin limits, a cluster of area a falls in bin k if breaks[k]<a<=breaks[k+1] (the
+ * first bin including breaks[0] itself), clusters outside all the bins are counted but not binned.
+ * @param threads the number of threads to use, values below 1 mean as many as there are hardware threads.
+ * @param results receives one result per parameter set, in the order of the grid.
+ */
+void clusterSweep(const double *intensities, const int nrow, const int ncol, const std::vector<ClusterParams> &grid,
+                  const std::vector<double> &breaks, const int threads, std::vector<SweepResult> &results);
+
+#endif
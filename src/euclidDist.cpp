@@ -1,7 +1,20 @@
 #include <Rcpp.h>
 #include <math.h>  
+#include <string>
+#include "pointDistance.h"
 using namespace Rcpp;
 
+/**
+ * Stops if any coordinate is NA, NaN or infinite, as no distance to it could be ordered.
+ */
+static void checkFinite(const NumericMatrix &points, const char *what){
+  for(R_xlen_t i=0;i<points.size();i++){
+    if(!R_finite(points[i])){
+      stop(std::string(what)+" must be finite");
+    }
+  }
+}
+
 // [[Rcpp::export]]
 RcppExport SEXP euclidDist(SEXP x, SEXP y) {
    
@@ -15,3 +28,67 @@ RcppExport SEXP euclidDist(SEXP x, SEXP y) {
    
    return(wrap(sqrt(sum)));
 }
+
+/**
+ * Rcpp export function, computes the distances between all the points of two coordinate matrices at once.
+ * @param x a numeric matrix of points, one row per point.
+ * @param y another numeric matrix of points with as many columns, or NULL for the distances within x.
+ * @param nThreads number of threads to use, values below 1 mean as many as there are hardware threads.
+ * @return a nrow(x)*nrow(y) numeric matrix of distances.
+ */
+// [[Rcpp::export]]
+RcppExport SEXP euclidDistMatrix(SEXP x, SEXP y, SEXP nThreads) {
+BEGIN_RCPP
+   const NumericMatrix xx(x);
+   const NumericMatrix yy(Rf_isNull(y)?x:y);
+   const IntegerVector threadsV(nThreads);
+   if(xx.ncol()!=yy.ncol()){
+     stop("the points must be of the same dimension");
+   }
+   
+   NumericMatrix out(xx.nrow(),yy.nrow());
+   crossDistances(PointSet(xx.begin(),xx.nrow(),xx.ncol()), PointSet(yy.begin(),yy.nrow(),yy.ncol()),
+                  threadsV[0], out.begin());
+   return out;
+END_RCPP
+}
+
+/**
+ * Rcpp export function, finds the k nearest neighbors of points.
+ * @param x a numeric matrix of query points, one row per point, with finite coordinates only.
+ * @param y a numeric matrix of points to search with as many columns, or NULL to search x itself, in which case
+ * a point is not its own neighbor.
+ * @param k number of neighbors.
+ * @param nThreads number of threads to use, values below 1 mean as many as there are hardware threads.
+ * @return a List of two nrow(x)*k matrices: the 1-based row indices of the neighbors in y (index), nearest
+ * first, and the distances to them (dist).
+ */
+// [[Rcpp::export]]
+RcppExport SEXP euclidKnn(SEXP x, SEXP y, SEXP k, SEXP nThreads) {
+BEGIN_RCPP
+   const bool self=Rf_isNull(y);
+   const NumericMatrix xx(x);
+   const NumericMatrix yy(self?x:y);
+   const int kk=as<int>(k);
+   const IntegerVector threadsV(nThreads);
+   if(xx.ncol()!=yy.ncol()){
+     stop("the points must be of the same dimension");
+   }
+   if(kk<1||kk>yy.nrow()-(self?1:0)){
+     stop("k must be between 1 and the number of points to search");
+   }
+   checkFinite(xx,"the query points");
+   if(!self){
+     checkFinite(yy,"the points to search");
+   }
+   
+   IntegerMatrix index(xx.nrow(),kk);
+   NumericMatrix dist(xx.nrow(),kk);
+   nearestNeighbors(PointSet(xx.begin(),xx.nrow(),xx.ncol()), PointSet(yy.begin(),yy.nrow(),yy.ncol()), kk, self,
+                    threadsV[0], index.begin(), dist.begin());
+   for(int i=0;i<index.size();i++){
+     index[i]++;
+   }
+   return List::create(Named("index")=index, Named("dist")=dist);
+END_RCPP
+}
@@ -2,11 +2,9 @@
  * @file
  * @section ALGORITHM DESCRIPTION
  * 
- * The code below performs the most computationally intense parts of the algorithm. The file contains a 
- * number of funcitons, do not make much sense taken alone.
- * Instead, they make the code in the algorithm more readable and coherent. The code still conatins some
- * object space allocations, which could be avoided, however, these seem unlikely to have much impact on the
- * performance.
+ * The code below (together with the plain C++ core in clusterCore.cpp) performs the most computationally
+ * intense parts of the algorithm. Pixels are handled as integer indices into a padded, bit-packed field
+ * (see PixelField), so the cluster expansion itself does not allocate any objects per pixel.
  * 
  * The idea behind the algorithm stems from the fact that retinal cells on a confocal scan image form 
  * clusters of bright dots, which do not necessarily form a circle or even a homogenious 
@@ -17,13 +15,14 @@
  * cells of different shapes in the same image rather challenging.
  * 
  * The algorithm starts with a normalized N*M (N=M for most cases) matrix (the image), where the intensity of
- * a given dot is in [0,1] range. The coordinates of all dots are sorted by intensity descending. A certain 
- * cutoff is chosen such that all dots with intensitites lower that the cutoff are cosidered "background" and
- * are converted to zero values. The algorithm starts with the top (brightest) dot. It goes in a recursive
+ * a given dot is in [0,1] range. A certain cutoff is chosen such that all dots with intensitites lower that
+ * the cutoff are cosidered "background". The coordinates of all the remaining dots are sorted by intensity
+ * descending (with a bucket sort, as the range is known). The algorithm starts with the top (brightest) dot. It goes in a depth-first
  * search for dots around the "brighest": each pixel "looks up, down, left and right" and checks if its 
  * neighbors can be also cosidered for inclusion in the cluster (which ideally will cover and represent
- * a cell in the image). It (the current pixel) then passes control up the stack to the neighbor, 
- * which in turn checks its surroundings. It won't pass control to a pixel if:
+ * a cell in the image). It (the current pixel) then passes control to the neighbor, 
+ * which in turn checks its surroundings. The search keeps its state in an explicit, reusable stack rather
+ * than recursing, so large clusters can not overflow the C stack. It won't pass control to a pixel if:
  * - the pixel has 0 intensity (not intense enough = "background")
  * - is out of scope (goes out of reasonable field that a cell may occupy). This feature is controlled by the
  *   "width" and "var" parameters, which do not allow to expand out too far from the brighest dot
@@ -47,311 +46,260 @@
  * @author Alex Tuzhikov <alexander.tuzhikov@gmail.com>
  * @version 0.1
  */
+#include <chrono>
+
 #include "getClusters.h"
 
 /**
- * Sets true (= "visited") to a path point indicated in xys_i.
- * @param path a reference to a LogicalMatrix that represents points that have been visited
- * and those that have not.
- * @param xys_i reference to an integer vector of two coordinates (x,y), that indicate a position in either
- * intensity matrix, or path matrix.
+ * Wraps clusters into the R representation returned by getClusters: a List with one two-column integer matrix
+ * of 1-based (x,y) coordinates per cluster.
+ * @param clusters the clusters, the pixels/dots given as 0-based column-major image indices.
+ * @param nrow number of rows in the image.
+ * @return the list of cluster coordinate matrices.
  */
-inline void setVisited(LogicalMatrix &path, const IntegerVector &xys_i){
-  path(xys_i[0]-1,xys_i[1]-1)=true;
+List wrapClusters(const ClusterSet &clusters, const int nrow){
+   List outClusterList(clusters.size());
+   for(size_t i=0;i<clusters.size();i++){
+     const int *pixels=&clusters.pixels[clusters.offsets[i]];
+     const int size=clusters.clusterSize(i);
+     IntegerMatrix im(size,2);
+     
+     for(int j=0;j<size;j++){
+       im(j,0)=pixels[j]%nrow+1;
+       im(j,1)=pixels[j]/nrow+1;
+     }
+     
+     outClusterList[i]=im;
+   }
+   return outClusterList;
 }
 
 /**
- * Sets false (= "not visited") to a path point indicated in xys_i.
- * @param path a reference to a LogicalMatrix that represents points that have been visited
- * and those that have not.
- * @param xys_i reference to an integer vector of two coordinates (x,y), that indicate a position in either
- * intensity matrix, or path matrix.
+ * Wraps clusters into a label image: an integer matrix of the image size, holding the (1-based) number of the
+ * cluster each pixel/dot belongs to, 0 for the pixels/dots of no cluster.
+ * @param clusters the clusters, the pixels/dots given as 0-based column-major image indices.
+ * @param nrow number of rows in the image.
+ * @param ncol number of columns in the image.
+ * @return the label matrix.
  */
-inline void removeVisited(LogicalMatrix &path, const IntegerVector &xys_i){
-  path(xys_i[0]-1,xys_i[1]-1)=false;
+IntegerMatrix wrapLabels(const ClusterSet &clusters, const int nrow, const int ncol){
+   IntegerMatrix labels(nrow,ncol);
+   int *label=labels.begin();
+   for(size_t i=0;i<clusters.size();i++){
+     for(size_t j=clusters.offsets[i];j<clusters.offsets[i+1];j++){
+       label[clusters.pixels[j]]=i+1;
+     }
+   }
+   return labels;
 }
 
 /**
- * Checks whether a coordinate given in xys_i is in bounds of the image field (i.e. (-1,0) is not).
- * @param img a reference to an image intensity matrix.
- * @param xys_i reference to an integer vector of two coordinates (x,y), that indicate a position in either
- * intensity matrix, or path matrix.
- * @return true if the point is in field, false otherwise.
+ * Wraps clusters into a compressed sparse row like pair: a two-column integer matrix of the 1-based (x,y)
+ * coordinates of all the pixels/dots, cluster after cluster, and a vector of offsets into it, cluster i (1-based)
+ * occupying rows (offsets[i]+1):offsets[i+1].
+ * @param clusters the clusters, the pixels/dots given as 0-based column-major image indices.
+ * @param nrow number of rows in the image.
+ * @return a List with the offsets and the coords.
  */
-inline const bool inField(const NumericMatrix &img, const IntegerVector &xys_i){
-  return(xys_i[0]-1>=0&&xys_i[0]-1<img.ncol()&&xys_i[1]-1>=0&&xys_i[1]-1<img.nrow());
+List wrapCsr(const ClusterSet &clusters, const int nrow){
+   IntegerVector offsets(clusters.offsets.begin(), clusters.offsets.end());
+   const int count=clusters.pixels.size();
+   IntegerMatrix coords(count,2);
+   int *x=coords.begin();
+   int *y=x+count;
+   for(int j=0;j<count;j++){
+     x[j]=clusters.pixels[j]%nrow+1;
+     y[j]=clusters.pixels[j]/nrow+1;
+   }
+   return List::create(Named("offsets")=offsets, Named("coords")=coords);
 }
 
 /**
- * Checks if the coordinate given in xys_i has been visited yet (potentially by another expanding cluster)
- * @param path a reference to a LogicalMatrix that represents points that have been visited
- * and those that have not.
- * @param xys_i reference to an integer vector of two coordinates (x,y), that indicate a position in either
- * intensity matrix, or path matrix.
- * @return true if the point has been visited, false otherwise.
+ * Wraps the cluster summaries into a data.frame with one row per cluster: the 1-based (X,Y) coordinates of its
+ * centre, its area, and its mean and peak intensities.
+ * @param clusters the clusters, must have been summarized.
+ * @return the data.frame of cluster centres.
  */
-inline const bool hasBeenVisited(LogicalMatrix &path, const IntegerVector &xys_i){
-  return path(xys_i[0]-1,xys_i[1]-1);
+DataFrame wrapCentres(const ClusterSet &clusters){
+   const int count=clusters.summaries.size();
+   NumericVector x(count);
+   NumericVector y(count);
+   IntegerVector area(count);
+   NumericVector meanIntensity(count);
+   NumericVector peakIntensity(count);
+   for(int i=0;i<count;i++){
+     const ClusterSummary &summary=clusters.summaries[i];
+     x[i]=summary.centreX();
+     y[i]=summary.centreY();
+     area[i]=summary.area;
+     meanIntensity[i]=summary.meanIntensity();
+     peakIntensity[i]=summary.peakIntensity;
+   }
+   return DataFrame::create(Named("X")=x, Named("Y")=y, Named("area")=area,
+                            Named("mean.intensity")=meanIntensity, Named("peak.intensity")=peakIntensity);
 }
 
 /**
- * Checks if the pixel/dot given in xys_i is brigh enough to be considered a part of the cell.
- * In fact, this function just checks if the intesity of a pixel is greater than 0, as it is
- * assumed that the intesity matrix has already been trimmed to a background cutoff.
- * @param img a reference to an image intensity matrix.
- * @param xys_i reference to an integer vector of two coordinates (x,y), that indicate a position in either
- * intensity matrix, or path matrix.
- * @return true if the pixel is bright (intensity greater than zero in this case), false otherwise.
+ * Wraps the counters of a search and the times its phases took into the stats list get.clusters() attaches to
+ * its result. The counts are doubles, as they may exceed the range of an R integer on large images.
+ * @param stats the counters of the search.
+ * @param phases the names of the phases.
+ * @param seconds the time each phase took, in seconds.
+ * @return the stats list.
  */
-inline const bool brightEnough(const NumericMatrix &img, const IntegerVector &xys_i){
-  return(img(xys_i[0]-1,xys_i[1]-1)>0);
+List wrapStats(const SearchStats &stats, const std::vector<std::string> &phases, const std::vector<double> &seconds){
+   NumericVector timings(seconds.begin(), seconds.end());
+   timings.attr("names")=CharacterVector(phases.begin(), phases.end());
+   return List::create(Named("timings")=timings,
+                       Named("seeds.scanned")=(double)stats.seedsScanned,
+                       Named("clusters.grown")=(double)stats.clustersGrown,
+                       Named("pixels.probed")=(double)stats.pixelsProbed,
+                       Named("pixels.tested")=(double)stats.pixelsTested,
+                       Named("pixels.accepted")=(double)stats.pixelsAccepted,
+                       Named("clusters.kept")=(double)stats.clustersKept,
+                       Named("rejected.small")=(double)stats.rejectedSmall,
+                       Named("rejected.large")=(double)stats.rejectedLarge,
+                       Named("peak.stack.depth")=(double)stats.peakStackDepth);
 }
 
 /**
- * Checks of a pixel/dot given in xys_i is close (Euclidean distance) from the starting point (the brighest
- * point in the cluster).
- * @param xys_i reference to an integer vector of two coordinates (x,y), that indicate a position in either
- * intensity matrix, or path matrix.
- * @param start reference to the starting pixel/dot (the brighest one in the cluster).
- * @param width a diameter of a cluster (cell)
- * @param var variance value, which rougly estimates how much the cells may vary in diameter
- * @return true if the given pixel/dot can be considered as a part of a cell, false if
- * the pixel/dot lays outside the reasonable cell size.
+ * @return the seconds elapsed since start, restarting the clock.
  */
-inline const bool closeEnough(const IntegerVector &xys_i,const IntegerVector &start, 
-                                 const double width, const double var){
-  const double dist=sqrt(pow(xys_i[0]-start[0],2)+pow(xys_i[1]-start[1],2));
-  const double dist_var=dist+var/2;
-  const double radius=(width+var)/2;
-  return(dist_var<=radius);
+static double lap(std::chrono::steady_clock::time_point &start){
+   const std::chrono::steady_clock::time_point now=std::chrono::steady_clock::now();
+   const double seconds=std::chrono::duration<double>(now-start).count();
+   start=now;
+   return seconds;
 }
 
 /**
- * Convinience function, checks all 4 conditions for a pixel/dot to be considered a part of a cell.
- * @param img a reference to an image intensity matrix.
- * @param path a reference to a LogicalMatrix that represents points that have been visited
- * and those that have not.
- * @param xys_i reference to an integer vector of two coordinates (x,y), that indicate a position in either
- * intensity matrix, or path matrix.
- * @param start reference to the starting pixel/dot (the brighest one in the cluster).
- * @param width a diameter of a cluster (cell)
- * @param var variance value, which rougly estimates how much the cells may vary in diameter
- * @return true if the given pixel/dot can be considered as a part of a cell, false if
- * the pixel/dot lays outside the reasonable cell size.
+ * Reads the expansion kernel picked with cluster.kernel() into the search parameters.
+ * @param kernel a List with the connectivity (4 or 8), the acceptance policy ("squared", "euclidean", "disk" or
+ * "gradient") and the gradient tolerance, or NULL to keep the defaults (4-connectivity, "squared").
+ * @param params receives the kernel.
  */
-inline const bool allChecks(const NumericMatrix &img, LogicalMatrix &path, const IntegerVector &xys_i,
-                               const IntegerVector &start, const double width, const double var){
-   if(inField(img,xys_i)){
-     const bool has_been_visited=hasBeenVisited(path,xys_i);
-     const bool bright_enough=brightEnough(img, xys_i);
-     const bool close_enough=closeEnough(xys_i, start, width, var);
-     return(!has_been_visited&&bright_enough&&close_enough);
+void readKernel(SEXP kernel, ClusterParams &params){
+   if(Rf_isNull(kernel)){
+     return;
+   }
+   List k(kernel);
+   params.connectivity=as<int>(k["connectivity"]);
+   if(params.connectivity!=4&&params.connectivity!=8){
+     stop("connectivity must be 4 or 8");
+   }
+   const std::string acceptance=as<std::string>(k["acceptance"]);
+   if(acceptance=="squared"){
+     params.acceptance=ClusterParams::ACCEPT_SQUARED;
+   }else if(acceptance=="euclidean"){
+     params.acceptance=ClusterParams::ACCEPT_EUCLIDEAN;
+   }else if(acceptance=="disk"){
+     params.acceptance=ClusterParams::ACCEPT_DISK;
+   }else if(acceptance=="gradient"){
+     params.acceptance=ClusterParams::ACCEPT_GRADIENT;
    }else{
-     return false;
+     stop("unknown acceptance: "+acceptance);
    }
+   params.gradientTolerance=as<double>(k["gradient.tolerance"]);
 }
 
 /**
- * Returns a pixel/cell to the right. NOTE: returns a pointer to an IntegerVector created with "new",
- * thereby care must be taken to "delete" the pointer to free the memory.
- * @param xys_i reference to an integer vector of two coordinates (x,y), that indicate a position in either
- * @retrun new IntegerVector with coordintaes of the cell to the right.
+ * Reads the overlay colours and markers picked with overlay.style().
+ * @param style a List with the colours (low, high, outline and marker, each 0xRRGGBB) and the marker size, or NULL
+ * to keep the defaults.
+ * @param overlayStyle receives the style.
  */
-inline const IntegerVector * right(const IntegerVector * xys_i){
-  IntegerVector * neigh = new IntegerVector(2);
-  (*neigh)[0]=(*xys_i)[0]+1;
-  (*neigh)[1]=(*xys_i)[1];
-  return neigh;
-}
-
-/**
- * Returns a pixel/cell to the left. NOTE: returns a pointer to an IntegerVector created with "new",
- * thereby care must be taken to "delete" the pointer to free the memory.
- * @param xys_i reference to an integer vector of two coordinates (x,y), that indicate a position in either
- * intensity matrix, or path matrix.
- * @retrun new IntegerVector with coordintaes of the cell to the left.
- */
-inline const IntegerVector * left(const IntegerVector * xys_i){
-  IntegerVector * neigh = new IntegerVector(2);
-  (*neigh)[0]=(*xys_i)[0]-1;
-  (*neigh)[1]=(*xys_i)[1];
-  return neigh;
-}
-
-/**
- * Returns a pixel/cell on top. NOTE: returns a pointer to an IntegerVector created with "new",
- * thereby care must be taken to "delete" the pointer to free the memory.
- * @param xys_i reference to an integer vector of two coordinates (x,y), that indicate a position in either
- * intensity matrix, or path matrix.
- * @retrun new IntegerVector with coordintaes of the cell on top.
- */
-inline const IntegerVector * up(const IntegerVector * xys_i){
- IntegerVector * neigh = new IntegerVector(2);
-  (*neigh)[0]=(*xys_i)[0];
-  (*neigh)[1]=(*xys_i)[1]+1;
-  return neigh;
-}
-
-/**
- * Returns a pixel/cell beneath. NOTE: returns a pointer to an IntegerVector created with "new",
- * thereby care must be taken to "delete" the pointer to free the memory.
- * @param xys_i reference to an integer vector of two coordinates (x,y), that indicate a position in either
- * intensity matrix, or path matrix.
- * @retrun new IntegerVector with coordintaes of the cell beneath.
- */
-inline const IntegerVector * down(const IntegerVector * xys_i){
-  IntegerVector * neigh = new IntegerVector(2);
-  (*neigh)[0]=(*xys_i)[0];
-  (*neigh)[1]=(*xys_i)[1]-1;
-  return neigh;
-}
-
-/**
- * Part one of two voids that recursively check the neighborhood and add the neighborhood pixels/dots to the cluster.
- * @param img a reference to an image intensity matrix.
- * @param path a reference to a LogicalMatrix that represents points that have been visited
- * and those that have not.
- * @param xys_i reference to an integer vector of two coordinates (x,y), that indicate a position in either
- * intensity matrix, or path matrix.
- * @param output a standard library vector of pointers to IntegerVector object, that represent (x,y) coordinates of
- * pixels/dots in the intensity or logic path matrices. One full vector forms a cluster -> cell in the image.
- * @param start reference to the starting pixel/dot (the brighest one in the cluster).
- * @param width a diameter of a cluster (cell)
- * @param var variance value, which rougly estimates how much the cells may vary in diameter
- * @return true if the given pixel/dot can be considered as a part of a cell, false if
- * the pixel/dot lays outside the reasonable cell size.
- */
-void checkNeighborhood(const NumericMatrix &img,LogicalMatrix &path, const IntegerVector * xys_i, 
-                                     std::vector<const IntegerVector *> * output, const IntegerVector  &startPoint, 
-                                     const double width, const double var){
-  //check if an adjasent pixel,is withing the view field, has been visited, is bright enough and is within the possible range
-  //right
-  
-  const IntegerVector * neighRight=right(xys_i);
-  checkNeighbor(img,path,neighRight,output,startPoint,width,var);
-  
-  const IntegerVector * neighUp=up(xys_i);
-  checkNeighbor(img,path,neighUp,output,startPoint,width,var);
-  
-  const IntegerVector * neighLeft=left(xys_i);
-  checkNeighbor(img,path,neighLeft,output,startPoint,width,var);
-  
-  const IntegerVector * neighDown=down(xys_i);
-  checkNeighbor(img,path,neighDown,output,startPoint,width,var);
-  
-}
-
-/**
- * Part two of two voids that recursively check the neighborhood and add the neighborhood pixels/dots to the cluster.
- * @param img a reference to an image intensity matrix.
- * @param path a reference to a LogicalMatrix that represents points that have been visited
- * and those that have not.
- * @param neigh pointer to an integer vector of two coordinates (x,y), that indicate the position 
- * of a neigboring pixel/dot.
- * @param output a standard library vector of pointers to IntegerVector object, that represent (x,y) coordinates of
- * pixels/dots in the intensity or logic path matrices. One full vector forms a cluster -> cell in the image.
- * @param start reference to the starting pixel/dot (the brighest one in the cluster).
- * @param width a diameter of a cluster (cell)
- * @param var variance value, which rougly estimates how much the cells may vary in diameter
- * @return true if the given pixel/dot can be considered as a part of a cell, false if
- * the pixel/dot lays outside the reasonable cell size.
- */
-void checkNeighbor(const NumericMatrix &img,LogicalMatrix &path, const IntegerVector * neigh, 
-                                     std::vector<const IntegerVector *> * output, const IntegerVector  &startPoint, 
-                                     const double width, const double var){
-  
-  if(allChecks(img,path,*neigh,startPoint,width,var)){
-    setVisited(path,*neigh);
-    output->push_back(neigh);
-    checkNeighborhood(img,path,neigh,output,startPoint,width,var);
-  }else{
-    delete neigh;
-  }
+void readOverlayStyle(SEXP style, OverlayStyle &overlayStyle){
+   if(Rf_isNull(style)){
+     return;
+   }
+   List s(style);
+   const IntegerVector colours(s["colours"]);
+   if(colours.size()!=4){
+     stop("an overlay style needs 4 colours");
+   }
+   overlayStyle.low=colours[0];
+   overlayStyle.high=colours[1];
+   overlayStyle.outline=colours[2];
+   overlayStyle.marker=colours[3];
+   overlayStyle.markerSize=as<int>(s["marker.size"]);
 }
 
 /**
  * Rcpp export function, 
  * @param imgMtx an image intensity matrix.
- * @param sortedXY a matrix of (x,y) coordinates, sorted by the corresponding pixel intensity descending.
- * @param pathMtx a logical matrix that represents points that have been visited
- * and those that have not (all false in the begining understandably).
+ * @param intensityCutoff background intensity cutoff, pixels/dots with lower intensities are not considered
+ * for inclusion in any cluster.
  * @param meanWidth a diameter of a cluster (cell).
  * @param varWidth variance value, which rougly estimates how much the cells may vary in diameter
  * @param minClusterArea is used if its value is lower than meanWidth-varWidth/2, that is, if the cells vary
  * in size so drastically (in case of ischemic shock for instance), that very small cells along with normal large
  * cells must be considered for counting.
+ * @param nThreads number of threads to search with, values below 1 mean as many as there are hardware threads.
+ * The clusters do not depend on it.
+ * @param outputMode "clusters" for the cluster coordinate matrices, "labels" for a label image (see wrapLabels()),
+ * "csr" for the flat offsets/coordinates pair (see wrapCsr()) or "centres" for the data.frame of cluster centres
+ * (see wrapCentres()), accumulated while the clusters grow, without the coordinates ever being kept.
+ * @param kernel the expansion kernel (see readKernel()).
+ * @param collectStats whether to count what the search does and time its phases, the result then carries the
+ * stats list (see wrapStats()) as its "stats" attribute. The search itself reports nothing on the console.
  * @return and unwrapped (cuz standard type for R/Rcpp) List of cluster corrdinate matrices, each representin 
- * a different cell.
+ * a different cell, or one of the other representations picked by outputMode.
  */
 // [[Rcpp::export]]
-RcppExport SEXP getClusters(SEXP imgMtx, SEXP sortedXY, SEXP pathMtx, SEXP meanWidth, SEXP varWidth, SEXP minClusterArea) {
+RcppExport SEXP getClusters(SEXP imgMtx, SEXP intensityCutoff, SEXP meanWidth, SEXP varWidth, SEXP minClusterArea,
+                            SEXP nThreads, SEXP outputMode, SEXP kernel, SEXP collectStats) {
+BEGIN_RCPP
+   const std::string mode=as<std::string>(outputMode);
+   if(mode!="clusters"&&mode!="labels"&&mode!="csr"&&mode!="centres"){
+     stop("unknown output mode: "+mode);
+   }
    
-   Rcout<<"Started cluster search.."<<std::endl;
    const NumericMatrix img(imgMtx);
-   Rcout<<"Intensity matrix read.."<<std::endl;
-         IntegerMatrix xys(sortedXY);
-   Rcout<<"Intensity gradient read.."<<std::endl;
-         LogicalMatrix path(pathMtx);
-   Rcout<<"Path read.."<<std::endl;
+   const NumericVector cutoffV(intensityCutoff);
    const NumericVector widthV(meanWidth);
-   Rcout<<"Width read.."<<std::endl;
    const NumericVector varV(varWidth);
-   Rcout<<"Variance read.."<<std::endl;
    const NumericVector mca(minClusterArea);
-   Rcout<<"Minimum cluster area read.."<<std::endl;
+   const IntegerVector threadsV(nThreads);
+   const bool wantStats=as<bool>(collectStats);
    
-   const double width=widthV[0];
-   const double var=varV[0];
-   const double minCA=mca[0];
+   ClusterParams params(cutoffV[0], widthV[0], varV[0], mca[0]);
+   readKernel(kernel, params);
    
-   List outClusterList;
-   const double area=3*pow((width)/2,2);
-   const double lowMargin=3*pow((width-var)/2,2);
-   const double highMargin=3*pow((width+var)/2,2);
-   double minCellArea=0;
-   if(lowMargin>minCA){
-     minCellArea=minCA;
-   }else{
-     minCellArea=lowMargin;
-   }
+   std::vector<double> seconds;
+   std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+   PixelField field(img.begin(), img.nrow(), img.ncol(), params.cutoff);
+   seconds.push_back(lap(start));
+   std::vector<int> seeds;
+   sortSeeds(img.begin(), img.nrow()*img.ncol(), params.cutoff, seeds);
+   seconds.push_back(lap(start));
    
-   Rcout<<"Area: "<<area<<"+/-"<<3*pow(var/2,2)<<std::endl;
+   ClusterSet clusters;
+   if(mode=="centres"){
+     clusters.keepPixels=false;
+     clusters.summarize=true;
+   }
+   SearchStats stats;
+   findClusters(field, seeds, params, threadsV[0], clusters, wantStats?&stats:0);
+   seconds.push_back(lap(start));
    
-   for(int i=0; i<xys.nrow();i++){
-     //check if the point has been visited
-     if(!hasBeenVisited(path,xys.row(i))){
-       //set visited
-       IntegerVector * currow=new IntegerVector(2);
-       (*currow)[0]=xys.row(i)[0];
-       (*currow)[1]=xys.row(i)[1];
-       
-       setVisited(path,xys.row(i));
-       std::vector<const IntegerVector*> * outputTemplate =new std::vector<const IntegerVector*>();
-       //check if the neigbor can be attached
-       outputTemplate->push_back(currow);
-       
-       checkNeighborhood(img, path, currow, outputTemplate, xys.row(i), width, var);
-       
-       if(outputTemplate->size()<=highMargin&&outputTemplate->size()>=minCellArea){
-         IntegerMatrix im(outputTemplate->size(),2);
-         Rcout<<"Cluster saved with: "<<outputTemplate->size()<<" dots.."<<std::endl;
-         
-         for(int j=0;j<outputTemplate->size();j++){
-          for(int k=0;k<2;k++){
-           im(j,k)=(*outputTemplate->at(j))[k];
-          }
-         }
-         
-         outClusterList.push_back(im); 
-       }
-       
-       while(!outputTemplate->empty()) delete outputTemplate->back(), outputTemplate->pop_back();
-       delete outputTemplate;
+   RObject out;
+   if(mode=="centres"){
+     out=wrapCentres(clusters);
+   }else{
+     toImageIndices(field, clusters);
+     if(mode=="labels"){
+       out=wrapLabels(clusters, img.nrow(), img.ncol());
+     }else if(mode=="csr"){
+       out=wrapCsr(clusters, img.nrow());
+     }else{
+       out=wrapClusters(clusters, img.nrow());
      }
    }
-   
-   Rcout<<"Done parsing clusters.."<<std::endl;
-   Rcout<<"Done assembling cluster list.."<<std::endl;
-
-   return outClusterList;
+   if(wantStats){
+     seconds.push_back(lap(start));
+     const char *phases[]={"field","seeds","search","assembly"};
+     out.attr("stats")=wrapStats(stats, std::vector<std::string>(phases, phases+4), seconds);
+   }
+   return out;
+END_RCPP
 }
@@ -1,156 +1,98 @@
 #include <Rcpp.h>
 #include <stdio.h>
 #include <math.h> 
+#include <string>
+#include <vector>
+
+#include "clusterCore.h"
+#include "clusterSearch.h"
+#include "overlayImage.h"
 
 using namespace Rcpp;
 
 /**
- * Sets true (= "visited") to a path point indicated in xys_i.
- * @param path a reference to a LogicalMatrix that represents points that have been visited
- * and those that have not.
- * @param xys_i reference to an integer vector of two coordinates (x,y), that indicate a position in either
- * intensity matrix, or path matrix.
+ * Wraps clusters into the R representation returned by getClusters: a List with one two-column integer matrix
+ * of 1-based (x,y) coordinates per cluster.
+ * @param clusters the clusters, the pixels/dots given as 0-based column-major image indices.
+ * @param nrow number of rows in the image.
+ * @return the list of cluster coordinate matrices.
  */
-inline void setVisited(LogicalMatrix &path, const IntegerVector &xys_i);
+List wrapClusters(const ClusterSet &clusters, const int nrow);
 
 /**
- * Sets false (= "not visited") to a path point indicated in xys_i.
- * @param path a reference to a LogicalMatrix that represents points that have been visited
- * and those that have not.
- * @param xys_i reference to an integer vector of two coordinates (x,y), that indicate a position in either
- * intensity matrix, or path matrix.
- */
-inline void removeVisited(LogicalMatrix &path, const IntegerVector &xys_i);
-/**
- * Checks whether a coordinate given in xys_i is in bounds of the image field (i.e. (-1,0) is not).
- * @param img a reference to an image intensity matrix.
- * @param xys_i reference to an integer vector of two coordinates (x,y), that indicate a position in either
- * intensity matrix, or path matrix. 
- * @return true if the point is in field, false otherwise.
- */
-inline const bool inField(const NumericMatrix &img, const IntegerVector &xys_i);
-/**
- * Checks if the coordinate given in xys_i has been visited yet (potentially by another expanding cluster)
- * @param path a reference to a LogicalMatrix that represents points that have been visited
- * and those that have not.
- * @param xys_i reference to an integer vector of two coordinates (x,y), that indicate a position in either
- * intensity matrix, or path matrix.
- * @return true if the point has been visited, false otherwise.
- */
-inline const bool hasBeenVisited(LogicalMatrix &path, const IntegerVector &xys_i);
-/**
- * Checks if the pixel/dot given in xys_i is brigh enough to be considered a part of the cell.
- * @param img a reference to an image intensity matrix.
- * @param xys_i reference to an integer vector of two coordinates (x,y), that indicate a position in either
- * intensity matrix, or path matrix.
- * @return true if the pixel is bright, false otherwise.
- */
-inline const bool brightEnough(const NumericMatrix &img, const IntegerVector &xys_i);
-/**
- * Checks of a pixel/dot given in xys_i is close (Euclidean distance) from the starting point (the brighest
- * point in the cluster).
- * @param xys_i reference to an integer vector of two coordinates (x,y), that indicate a position in either
- * intensity matrix, or path matrix.
- * @param start reference to the starting pixel/dot (the brighest one in the cluster).
- * @param width a diameter of a cluster (cell)
- * @param var variance value, which rougly estimates how much the cells may vary in diameter
- * @return true if the given pixel/dot can be considered as a part of a cell, false if
- * the pixel/dot lays outside the reasonable cell size.
+ * Wraps clusters into a label image: an integer matrix of the image size, holding the (1-based) number of the
+ * cluster each pixel/dot belongs to, 0 for the pixels/dots of no cluster.
+ * @param clusters the clusters, the pixels/dots given as 0-based column-major image indices.
+ * @param nrow number of rows in the image.
+ * @param ncol number of columns in the image.
+ * @return the label matrix.
  */
-inline const bool closeEnough(const IntegerVector &xys_i,const IntegerVector &start, 
-                        const double width, const double var);
-/**
- * Convinience function, checks all 4 conditions for a pixel/dot to be considered a part of a cell.
- * @param img a reference to an image intensity matrix.
- * @param path a reference to a LogicalMatrix that represents points that have been visited
- * and those that have not.
- * @param xys_i reference to an integer vector of two coordinates (x,y), that indicate a position in either
- * intensity matrix, or path matrix.
- * @param start reference to the starting pixel/dot (the brighest one in the cluster).
- * @param width a diameter of a cluster (cell)
- * @param var variance value, which rougly estimates how much the cells may vary in diameter
- * @return true if the given pixel/dot can be considered as a part of a cell, false if
- * the pixel/dot lays outside the reasonable cell size.
- */
-inline const bool allChecks(const NumericMatrix &img, LogicalMatrix &path, const IntegerVector &xys_i,
-                      const IntegerVector &start, const double width, const double var);
-/**
- * Returns a pixel/cell to the right.
- * @param xys_i reference to an integer vector of two coordinates (x,y), that indicate a position in either
- * intensity matrix, or path matrix.
- * @retrun new IntegerVector with coordintaes of the cell to the right.
- */
-inline const IntegerVector * right(const IntegerVector * xys_i);
+IntegerMatrix wrapLabels(const ClusterSet &clusters, const int nrow, const int ncol);
+
 /**
- * Returns a pixel/cell to the left.
- * @param xys_i reference to an integer vector of two coordinates (x,y), that indicate a position in either
- * intensity matrix, or path matrix.
- * @retrun new IntegerVector with coordintaes of the cell to the left.
+ * Wraps clusters into a compressed sparse row like pair: a two-column integer matrix of the 1-based (x,y)
+ * coordinates of all the pixels/dots, cluster after cluster, and a vector of offsets into it, cluster i (1-based)
+ * occupying rows (offsets[i]+1):offsets[i+1].
+ * @param clusters the clusters, the pixels/dots given as 0-based column-major image indices.
+ * @param nrow number of rows in the image.
+ * @return a List with the offsets and the coords.
  */
-inline const IntegerVector * left(const IntegerVector * xys_i);
+List wrapCsr(const ClusterSet &clusters, const int nrow);
+
 /**
- * Returns a pixel/cell on top of the given one.
- * @param xys_i reference to an integer vector of two coordinates (x,y), that indicate a position in either
- * intensity matrix, or path matrix.
- * @retrun new IntegerVector with coordintaes of the cell on top.
+ * Wraps the cluster summaries into a data.frame with one row per cluster: the 1-based (X,Y) coordinates of its
+ * centre, its area, and its mean and peak intensities.
+ * @param clusters the clusters, must have been summarized.
+ * @return the data.frame of cluster centres.
  */
-inline const IntegerVector * up(const IntegerVector * xys_i);
+DataFrame wrapCentres(const ClusterSet &clusters);
+
 /**
- * Returns a pixel/cell beneath the given one.
- * @param xys_i reference to an integer vector of two coordinates (x,y), that indicate a position in either
- * intensity matrix, or path matrix.
- * @retrun new IntegerVector with coordintaes of the cell beneath.
+ * Wraps the counters of a search and the times its phases took into the stats list get.clusters() attaches to
+ * its result. The counts are doubles, as they may exceed the range of an R integer on large images.
+ * @param stats the counters of the search.
+ * @param phases the names of the phases.
+ * @param seconds the time each phase took, in seconds.
+ * @return the stats list.
  */
-inline const IntegerVector * down(const IntegerVector * xys_i);
+List wrapStats(const SearchStats &stats, const std::vector<std::string> &phases, const std::vector<double> &seconds);
 
 /**
- * Part one of two voids that recursively check the neighborhood and add the neighborhood pixels/dots to the cluster.
- * @param img a reference to an image intensity matrix.
- * @param path a reference to a LogicalMatrix that represents points that have been visited
- * and those that have not.
- * @param xys_i reference to an integer vector of two coordinates (x,y), that indicate a position in either
- * intensity matrix, or path matrix.
- * @param output a standard library vector of pointers to IntegerVector object, that represent (x,y) coordinates of
- * pixels/dots in the intensity or logic path matrices. One full vector forms a cluster -> cell in the image.
- * @param start reference to the starting pixel/dot (the brighest one in the cluster).
- * @param width a diameter of a cluster (cell)
- * @param var variance value, which rougly estimates how much the cells may vary in diameter
- * @return true if the given pixel/dot can be considered as a part of a cell, false if
- * the pixel/dot lays outside the reasonable cell size.
+ * Reads the expansion kernel picked with cluster.kernel() into the search parameters.
+ * @param kernel a List with the connectivity (4 or 8), the acceptance policy ("squared", "euclidean", "disk" or
+ * "gradient") and the gradient tolerance, or NULL to keep the defaults (4-connectivity, "squared").
+ * @param params receives the kernel.
  */
-void checkNeighborhood(const NumericMatrix &img,LogicalMatrix &path, const IntegerVector * xys_i, 
-                       std::vector<const IntegerVector *> * output, const IntegerVector  &startPoint, 
-                       const double width, const double var);
+void readKernel(SEXP kernel, ClusterParams &params);
+
 /**
- * Part two of two voids that recursively check the neighborhood and add the neighborhood pixels/dots to the cluster.
- * @param img a reference to an image intensity matrix.
- * @param path a reference to a LogicalMatrix that represents points that have been visited
- * and those that have not.
- * @param neigh pointer to an integer vector of two coordinates (x,y), that indicate the position 
- * of a neigboring pixel/dot.
- * @param output a standard library vector of pointers to IntegerVector object, that represent (x,y) coordinates of
- * pixels/dots in the intensity or logic path matrices. One full vector forms a cluster -> cell in the image.
- * @param start reference to the starting pixel/dot (the brighest one in the cluster).
- * @param width a diameter of a cluster (cell)
- * @param var variance value, which rougly estimates how much the cells may vary in diameter
- * @return true if the given pixel/dot can be considered as a part of a cell, false if
- * the pixel/dot lays outside the reasonable cell size.
+ * Reads the overlay colours and markers picked with overlay.style().
+ * @param style a List with the colours (low, high, outline and marker, each 0xRRGGBB) and the marker size, or NULL
+ * to keep the defaults.
+ * @param overlayStyle receives the style.
  */
-void checkNeighbor(const NumericMatrix &img,LogicalMatrix &path, const IntegerVector * neigh, 
-                   std::vector<const IntegerVector *> * output, const IntegerVector  &startPoint, 
-                   const double width, const double var);
+void readOverlayStyle(SEXP style, OverlayStyle &overlayStyle);
+
 /**
  * Rcpp export function, 
  * @param imgMtx an image intensity matrix.
- * @param sortedXY a matrix of (x,y) coordinates, sorted by the corresponding pixel intensity descending.
- * @param pathMtx a logical matrix that represents points that have been visited
- * and those that have not (all false in the begining understandably).
+ * @param intensityCutoff background intensity cutoff, pixels/dots with lower intensities are not considered
+ * for inclusion in any cluster.
  * @param meanWidth a diameter of a cluster (cell).
  * @param varWidth variance value, which rougly estimates how much the cells may vary in diameter
  * @param minClusterArea is used if its value is lower than meanWidth-varWidth/2, that is, if the cells vary
  * in size so drastically (in case of ischemic shock for instance), that very small cells along with normal large
  * cells must be considered for counting.
+ * @param nThreads number of threads to search with, values below 1 mean as many as there are hardware threads.
+ * The clusters do not depend on it.
+ * @param outputMode "clusters" for the cluster coordinate matrices, "labels" for a label image (see wrapLabels()),
+ * "csr" for the flat offsets/coordinates pair (see wrapCsr()) or "centres" for the data.frame of cluster centres
+ * (see wrapCentres()), accumulated while the clusters grow, without the coordinates ever being kept.
+ * @param kernel the expansion kernel (see readKernel()).
+ * @param collectStats whether to count what the search does and time its phases, the result then carries the
+ * stats list (see wrapStats()) as its "stats" attribute. The search itself reports nothing on the console.
  * @return and unwrapped (cuz standard type for R/Rcpp) List of cluster corrdinate matrices, each representin 
- * a different cell.
+ * a different cell, or one of the other representations picked by outputMode.
  */
-RcppExport SEXP getClusters(SEXP imgMtx, SEXP sortedXY, SEXP pathMtx, SEXP meanWidth, SEXP varWidth, SEXP minClusterArea);
+RcppExport SEXP getClusters(SEXP imgMtx, SEXP intensityCutoff, SEXP meanWidth, SEXP varWidth, SEXP minClusterArea,
+                            SEXP nThreads, SEXP outputMode, SEXP kernel, SEXP collectStats);
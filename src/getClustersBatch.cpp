@@ -0,0 +1,97 @@
+#include <sstream>
+
+#include "getClusters.h"
+#include "clusterBatch.h"
+#include "imageCache.h"
+
+/**
+ * Rcpp export function, clusters a whole list of images with the same parameters in one call.
+ * @param imgList a list of image intensity matrices, or a character vector of paths to TIFF images, which are
+ * then read (and normalized) by the worker threads.
+ * @param intensityCutoff background intensity cutoff, pixels/dots with lower intensities are not considered
+ * for inclusion in any cluster.
+ * @param meanWidth a diameter of a cluster (cell).
+ * @param varWidth variance value, which rougly estimates how much the cells may vary in diameter
+ * @param minClusterArea see getClusters.
+ * @param nThreads number of threads to use, values below 1 mean as many as there are hardware threads.
+ * @param kernel the expansion kernel (see readKernel()).
+ * @param overlayFiles NULL, or a character vector of paths (one per image) the overlays of the clusters are
+ * rendered to by the worker threads (see writeOverlay()), empty strings for none.
+ * @param overlayStyle the colours and markers of the overlays (see readOverlayStyle()).
+ * @param cacheDir NULL, or the directory of the cache files of the images given as paths (see CachedImage), named
+ * by cacheFileName().
+ * @param outputMode "clusters" for the cluster coordinate matrices, "centres" for the data.frames of cluster centres
+ * (see wrapCentres()), summarized by the workers while the clusters grow, the coordinates never being kept.
+ * @return a List with one element per image, each one a List of cluster corrdinate matrices as returned by
+ * getClusters, or a data.frame of cluster centres.
+ */
+// [[Rcpp::export]]
+RcppExport SEXP getClustersBatch(SEXP imgList, SEXP intensityCutoff, SEXP meanWidth, SEXP varWidth,
+                                 SEXP minClusterArea, SEXP nThreads, SEXP kernel, SEXP overlayFiles,
+                                 SEXP overlayStyle, SEXP cacheDir, SEXP outputMode) {
+BEGIN_RCPP
+  const std::string mode=as<std::string>(outputMode);
+  if(mode!="clusters"&&mode!="centres"){
+    stop("unknown output mode: "+mode);
+  }
+  const bool centres=mode=="centres";
+  const NumericVector cutoffV(intensityCutoff);
+  const NumericVector widthV(meanWidth);
+  const NumericVector varV(varWidth);
+  const NumericVector mca(minClusterArea);
+  const IntegerVector threadsV(nThreads);
+  
+  ClusterParams params(cutoffV[0], widthV[0], varV[0], mca[0]);
+  readKernel(kernel, params);
+  
+  //the matrices are kept here, so that the coerced ones stay alive while the workers read them
+  std::vector<NumericMatrix> matrices;
+  std::vector<BatchImage> images;
+  if(TYPEOF(imgList)==STRSXP){
+    const std::vector<std::string> paths=as<std::vector<std::string> >(imgList);
+    const std::string cache=Rf_isNull(cacheDir)?std::string():as<std::string>(cacheDir);
+    for(size_t i=0;i<paths.size();i++){
+      images.push_back(BatchImage(paths[i]));
+      if(!cache.empty()){
+        images.back().cache=cacheFileName(cache, paths[i]);
+      }
+    }
+  }else{
+    const List imgs(imgList);
+    for(int i=0;i<imgs.size();i++){
+      matrices.push_back(NumericMatrix((SEXP)imgs[i]));
+      const NumericMatrix &img=matrices.back();
+      images.push_back(BatchImage(img.begin(), img.nrow(), img.ncol()));
+    }
+  }
+  if(!Rf_isNull(overlayFiles)){
+    const std::vector<std::string> overlays=as<std::vector<std::string> >(overlayFiles);
+    if(overlays.size()!=images.size()){
+      stop("there must be one overlay file per image");
+    }
+    for(size_t i=0;i<images.size();i++){
+      images[i].overlay=overlays[i];
+    }
+  }
+  OverlayStyle style;
+  readOverlayStyle(overlayStyle, style);
+  std::vector<BatchResult> results;
+  clusterBatch(images, params, threadsV[0], results, !centres, centres, style);
+  
+  List out(results.size());
+  for(size_t i=0;i<results.size();i++){
+    if(!results[i].error.empty()){
+      std::ostringstream message;
+      message<<"image "<<i+1<<": "<<results[i].error;
+      stop(message.str());
+    }
+    if(centres){
+      out[i]=wrapCentres(results[i].clusters);
+    }else{
+      out[i]=wrapClusters(results[i].clusters, results[i].nrow);
+    }
+  }
+  
+  return out;
+END_RCPP
+}
@@ -0,0 +1,102 @@
+#include <memory>
+
+#include "getClusters.h"
+#include "streamSearch.h"
+
+/**
+ * Collects the summaries of the clusters of all the bands.
+ */
+class CentreSink : public ClusterSink {
+public:
+  CentreSink(){
+    clusters.keepPixels=false;
+    clusters.summarize=true;
+  }
+  void emit(const ClusterSet &band, const PixelField &, const int){
+    for(size_t i=0;i<band.size();i++){
+      clusters.add(band.clusterSize(i), band.summaries[i]);
+    }
+  }
+  ClusterSet clusters;
+};
+
+/**
+ * Collects the image coordinates of the pixels/dots of the clusters of all the bands, as wrapCsr() lays them out.
+ */
+class CsrSink : public ClusterSink {
+public:
+  CsrSink():offsets(1,0){}
+  void emit(const ClusterSet &band, const PixelField &field, const int firstRow){
+    for(size_t i=0;i<band.pixels.size();i++){
+      x.push_back(firstRow+field.x(band.pixels[i]));
+      y.push_back(field.y(band.pixels[i]));
+    }
+    for(size_t i=0;i<band.size();i++){
+      offsets.push_back(offsets.back()+band.clusterSize(i));
+    }
+  }
+  std::vector<int> offsets;
+  std::vector<int> x;
+  std::vector<int> y;
+};
+
+/**
+ * Rcpp export function, searches an image file band by band (see streamSearch.h), so that only a window of rows
+ * is ever held in memory.
+ * @param path path to the image file.
+ * @param rawDim NULL for a TIFF file, the number of rows and columns of the image for a raw file (see RawImage).
+ * @param rawType "double" or "float", the type of the values of a raw file.
+ * @param rawByRow whether a raw file stores the values row after row rather than column after column.
+ * @param intensityCutoff background intensity cutoff.
+ * @param meanWidth a diameter of a cluster (cell).
+ * @param varWidth variance value, which rougly estimates how much the cells may vary in diameter
+ * @param minClusterArea see getClusters.
+ * @param bandRows the number of rows in a band.
+ * @param normalize whether to rescale the intensities to [0,1] (as read.tiff.image does).
+ * @param mmap whether to memory-map the file.
+ * @param nThreads number of threads to search each band with, values below 1 mean as many as there are hardware
+ * threads.
+ * @param outputMode "centres" for the data.frame of cluster centres (see wrapCentres()) or "csr" for the flat
+ * offsets/coordinates pair (see wrapCsr()).
+ * @param kernel the expansion kernel (see readKernel()).
+ * @return the clusters in the representation picked by outputMode, band after band.
+ */
+// [[Rcpp::export]]
+RcppExport SEXP getClustersStream(SEXP path, SEXP rawDim, SEXP rawType, SEXP rawByRow, SEXP intensityCutoff,
+                                  SEXP meanWidth, SEXP varWidth, SEXP minClusterArea, SEXP bandRows,
+                                  SEXP normalize, SEXP mmap, SEXP nThreads, SEXP outputMode, SEXP kernel) {
+BEGIN_RCPP
+  const std::string file=as<std::string>(path);
+  const bool mapped=as<bool>(mmap);
+  ClusterParams params(as<double>(intensityCutoff), as<double>(meanWidth), as<double>(varWidth),
+                       as<double>(minClusterArea));
+  readKernel(kernel, params);
+  const std::string mode=as<std::string>(outputMode);
+  
+  std::unique_ptr<RowSource> source;
+  if(Rf_isNull(rawDim)){
+    source.reset(new TiffRowSource(file, mapped));
+  }else{
+    const IntegerVector dim(rawDim);
+    const RawImage::SampleType type=as<std::string>(rawType)=="float"?RawImage::FLOAT:RawImage::DOUBLE;
+    source.reset(new RawRowSource(file, dim[0], dim[1], type, as<bool>(rawByRow), mapped));
+  }
+  
+  ClusterSet band;
+  if(mode=="csr"){
+    CsrSink sink;
+    streamClusters(*source, params, as<int>(bandRows), as<bool>(normalize), as<int>(nThreads), band, sink);
+    const int count=sink.x.size();
+    IntegerMatrix coords(count,2);
+    std::copy(sink.x.begin(), sink.x.end(), coords.begin());
+    std::copy(sink.y.begin(), sink.y.end(), coords.begin()+count);
+    return List::create(Named("offsets")=IntegerVector(sink.offsets.begin(), sink.offsets.end()),
+                        Named("coords")=coords);
+  }
+  band.keepPixels=false;
+  band.summarize=true;
+  CentreSink sink;
+  streamClusters(*source, params, as<int>(bandRows), as<bool>(normalize), as<int>(nThreads), band, sink);
+  return wrapCentres(sink.clusters);
+END_RCPP
+}
@@ -0,0 +1,54 @@
+#include "getClusters.h"
+#include "clusterSweep.h"
+
+/**
+ * Rcpp export function, searches an image with a whole grid of parameter sets, thresholding the image and
+ * sorting its seeds only once (see clusterSweep.h).
+ * @param imgMtx an image intensity matrix.
+ * @param intensityCutoff background intensity cutoffs, one per parameter set.
+ * @param meanWidth cluster (cell) diameters, one per parameter set.
+ * @param varWidth variance values, one per parameter set.
+ * @param minClusterArea minimum cluster areas (see getClusters), one per parameter set.
+ * @param areaBreaks ascending area bin limits for the histograms.
+ * @param nThreads number of threads to use, values below 1 mean as many as there are hardware threads.
+ * @param kernel the expansion kernel of all the parameter sets (see readKernel()).
+ * @return a List with the number of clusters found with every parameter set (counts) and an integer matrix of
+ * the cluster area histograms (histograms), one row per parameter set.
+ */
+// [[Rcpp::export]]
+RcppExport SEXP getClustersSweep(SEXP imgMtx, SEXP intensityCutoff, SEXP meanWidth, SEXP varWidth,
+                                 SEXP minClusterArea, SEXP areaBreaks, SEXP nThreads, SEXP kernel) {
+BEGIN_RCPP
+  const NumericMatrix img(imgMtx);
+  const NumericVector cutoffV(intensityCutoff);
+  const NumericVector widthV(meanWidth);
+  const NumericVector varV(varWidth);
+  const NumericVector mca(minClusterArea);
+  const IntegerVector threadsV(nThreads);
+  const std::vector<double> breaks=as<std::vector<double> >(areaBreaks);
+  
+  const int count=cutoffV.size();
+  if(widthV.size()!=count||varV.size()!=count||mca.size()!=count){
+    stop("all the parameter vectors must be of the same length");
+  }
+  std::vector<ClusterParams> grid;
+  for(int i=0;i<count;i++){
+    grid.push_back(ClusterParams(cutoffV[i], widthV[i], varV[i], mca[i]));
+    readKernel(kernel, grid.back());
+  }
+  
+  std::vector<SweepResult> results;
+  clusterSweep(img.begin(), img.nrow(), img.ncol(), grid, breaks, threadsV[0], results);
+  
+  const int bins=breaks.size()>1?breaks.size()-1:0;
+  IntegerVector counts(count);
+  IntegerMatrix histograms(count,bins);
+  for(int i=0;i<count;i++){
+    counts[i]=results[i].count;
+    for(int b=0;b<bins;b++){
+      histograms(i,b)=results[i].histogram[b];
+    }
+  }
+  return List::create(Named("counts")=counts, Named("histograms")=histograms);
+END_RCPP
+}
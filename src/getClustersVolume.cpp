@@ -0,0 +1,147 @@
+#include "getClusters.h"
+#include "volumeSearch.h"
+
+/**
+ * Wraps clusters of voxels into a List with one three-column integer matrix of 1-based (x,y,z) coordinates per
+ * cluster, as wrapClusters() does for an image.
+ */
+static List wrapVolumeClusters(const VolumeClusterSet &clusters, const int nrow, const int ncol){
+   const int plane=nrow*ncol;
+   List outClusterList(clusters.size());
+   for(size_t i=0;i<clusters.size();i++){
+     const int *voxels=&clusters.pixels[clusters.offsets[i]];
+     const int size=clusters.clusterSize(i);
+     IntegerMatrix im(size,3);
+     for(int j=0;j<size;j++){
+       im(j,0)=voxels[j]%nrow+1;
+       im(j,1)=voxels[j]%plane/nrow+1;
+       im(j,2)=voxels[j]/plane+1;
+     }
+     outClusterList[i]=im;
+   }
+   return outClusterList;
+}
+
+/**
+ * Wraps clusters of voxels into a label array of the stack size, see wrapLabels().
+ */
+static IntegerVector wrapVolumeLabels(const VolumeClusterSet &clusters, const int nrow, const int ncol,
+                                      const int nslice){
+   IntegerVector labels((size_t)nrow*ncol*nslice);
+   int *label=labels.begin();
+   for(size_t i=0;i<clusters.size();i++){
+     for(size_t j=clusters.offsets[i];j<clusters.offsets[i+1];j++){
+       label[clusters.pixels[j]]=i+1;
+     }
+   }
+   labels.attr("dim")=IntegerVector::create(nrow, ncol, nslice);
+   return labels;
+}
+
+/**
+ * Wraps clusters of voxels into the offsets/coordinates pair of wrapCsr(), the coordinates having a third (z)
+ * column.
+ */
+static List wrapVolumeCsr(const VolumeClusterSet &clusters, const int nrow, const int ncol){
+   const int plane=nrow*ncol;
+   IntegerVector offsets(clusters.offsets.begin(), clusters.offsets.end());
+   const int count=clusters.pixels.size();
+   IntegerMatrix coords(count,3);
+   int *x=coords.begin();
+   int *y=x+count;
+   int *z=y+count;
+   for(int j=0;j<count;j++){
+     x[j]=clusters.pixels[j]%nrow+1;
+     y[j]=clusters.pixels[j]%plane/nrow+1;
+     z[j]=clusters.pixels[j]/plane+1;
+   }
+   return List::create(Named("offsets")=offsets, Named("coords")=coords);
+}
+
+/**
+ * Wraps the summaries of clusters of voxels into a data.frame with one row per cluster: the 1-based (X,Y,Z)
+ * coordinates of its centre, its volume (number of voxels), and its mean and peak intensities.
+ */
+static DataFrame wrapVolumeCentres(const VolumeClusterSet &clusters){
+   const int count=clusters.summaries.size();
+   NumericVector x(count);
+   NumericVector y(count);
+   NumericVector z(count);
+   IntegerVector volume(count);
+   NumericVector meanIntensity(count);
+   NumericVector peakIntensity(count);
+   for(int i=0;i<count;i++){
+     const VolumeSummary &summary=clusters.summaries[i];
+     x[i]=summary.centreX();
+     y[i]=summary.centreY();
+     z[i]=summary.centreZ();
+     volume[i]=summary.volume;
+     meanIntensity[i]=summary.meanIntensity();
+     peakIntensity[i]=summary.peakIntensity;
+   }
+   return DataFrame::create(Named("X")=x, Named("Y")=y, Named("Z")=z, Named("volume")=volume,
+                            Named("mean.intensity")=meanIntensity, Named("peak.intensity")=peakIntensity);
+}
+
+/**
+ * Rcpp export function, searches a z-stack for clusters of voxels (see volumeSearch.h).
+ * @param imgArr a rows x columns x slices intensity array (as returned by read.tiff.stack()).
+ * @param intensityCutoff background intensity cutoff.
+ * @param meanWidth a diameter of a cluster (cell), in pixels/dots.
+ * @param varWidth variance value, which rougly estimates how much the cells may vary in diameter
+ * @param minClusterVolume is used if its value is lower than the volume implied by meanWidth-varWidth, see
+ * getClusters.
+ * @param zScale the distance between two slices, in pixels/dots.
+ * @param connectivity 6 or 26, the number of neighbors a cluster grows to around each of its voxels.
+ * @param nThreads number of threads to search with, values below 1 mean as many as there are hardware threads.
+ * The clusters do not depend on it.
+ * @param outputMode "clusters", "labels", "csr" or "centres", as for getClusters, with a z coordinate.
+ * @return the clusters in the representation picked by outputMode.
+ */
+// [[Rcpp::export]]
+RcppExport SEXP getClustersVolume(SEXP imgArr, SEXP intensityCutoff, SEXP meanWidth, SEXP varWidth,
+                                  SEXP minClusterVolume, SEXP zScale, SEXP connectivity, SEXP nThreads,
+                                  SEXP outputMode) {
+BEGIN_RCPP
+   const std::string mode=as<std::string>(outputMode);
+   if(mode!="clusters"&&mode!="labels"&&mode!="csr"&&mode!="centres"){
+     stop("unknown output mode: "+mode);
+   }
+   const NumericVector img(imgArr);
+   const IntegerVector dim=img.attr("dim");
+   if(dim.size()!=3){
+     stop("the stack must be a 3-D array");
+   }
+   VolumeParams params(as<double>(intensityCutoff), as<double>(meanWidth), as<double>(varWidth),
+                       as<double>(minClusterVolume), as<double>(zScale), as<int>(connectivity));
+   if(params.connectivity!=6&&params.connectivity!=26){
+     stop("connectivity must be 6 or 26");
+   }
+   if(!(params.zScale>0)){
+     stop("the slices must be a positive distance apart");
+   }
+   
+   VoxelField field(img.begin(), dim[0], dim[1], dim[2], params.cutoff);
+   std::vector<int> seeds;
+   sortSeeds(img.begin(), img.size(), params.cutoff, seeds);
+   
+   VolumeClusterSet clusters;
+   if(mode=="centres"){
+     clusters.keepPixels=false;
+     clusters.summarize=true;
+   }
+   findVolumeClusters(field, seeds.empty()?0:&seeds[0], seeds.size(), params, as<int>(nThreads), clusters);
+   
+   if(mode=="centres"){
+     return wrapVolumeCentres(clusters);
+   }
+   toImageIndices(field, clusters);
+   if(mode=="labels"){
+     return wrapVolumeLabels(clusters, dim[0], dim[1], dim[2]);
+   }
+   if(mode=="csr"){
+     return wrapVolumeCsr(clusters, dim[0], dim[1]);
+   }
+   return wrapVolumeClusters(clusters, dim[0], dim[1]);
+END_RCPP
+}
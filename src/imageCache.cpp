@@ -0,0 +1,239 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdexcept>
+#include <zlib.h>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "imageCache.h"
+#include "clusterCore.h"
+#include "tiffImage.h"
+
+/**
+ * Bumped whenever the layout of the cache files changes, the older ones are then rebuilt.
+ */
+static const uint32_t CACHE_VERSION=1;
+
+static const char CACHE_MAGIC[8]={'C','C','P','P','I','M','G','\0'};
+
+/**
+ * The header of a cache file.
+ */
+struct CacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t normalized;
+  uint64_t sourceSize;
+  uint32_t sourceHash;
+  int32_t nrow;
+  int32_t ncol;
+  int32_t reserved;
+  /**
+   * the cutoff the seeds were sorted with.
+   */
+  double cutoff;
+  uint64_t seedCount;
+  uint64_t padding;
+};
+
+static_assert(sizeof(CacheHeader)==64,"the cache header must be 64 bytes long");
+
+/**
+ * Computes the CRC-32 of a file.
+ * @param size receives the size of the file.
+ * @return the CRC-32.
+ */
+static uint32_t hashFile(const std::string &path, uint64_t &size){
+  FILE *file=fopen(path.c_str(),"rb");
+  if(!file){
+    throw std::runtime_error("can not open "+path);
+  }
+  std::vector<uint8_t> buffer(1<<20);
+  uLong crc=crc32(0,0,0);
+  size=0;
+  size_t count;
+  while((count=fread(&buffer[0],1,buffer.size(),file))>0){
+    crc=crc32(crc,&buffer[0],count);
+    size+=count;
+  }
+  const bool failed=ferror(file)!=0;
+  fclose(file);
+  if(failed){
+    throw std::runtime_error("can not read "+path);
+  }
+  return (uint32_t)crc;
+}
+
+/**
+ * @return the number of leading seeds at or above the cutoff.
+ */
+static size_t seedsAbove(const double *intensities, const int *seeds, const size_t count, const double cutoff){
+  size_t low=0;
+  size_t high=count;
+  while(low<high){
+    const size_t middle=low+(high-low)/2;
+    if(intensities[seeds[middle]]>=cutoff){
+      low=middle+1;
+    }else{
+      high=middle;
+    }
+  }
+  return low;
+}
+
+CachedImage::CachedImage(const std::string &imagePath, const std::string &cachePath, const double cutoff,
+                         const bool normalize)
+  :map_(0),mapSize_(0),nrow_(0),ncol_(0),intensities_(0),seeds_(0),seedCount_(0),reused_(false){
+  uint64_t sourceSize;
+  const uint32_t sourceHash=hashFile(imagePath,sourceSize);
+  reused_=open(cachePath,sourceSize,sourceHash,normalize,cutoff);
+  if(!reused_){
+    build(imagePath,cachePath,sourceSize,sourceHash,normalize,cutoff);
+  }
+}
+
+CachedImage::~CachedImage(){
+  close();
+}
+
+void CachedImage::close(){
+#ifndef _WIN32
+  if(map_){
+    munmap((void*)map_,mapSize_);
+    map_=0;
+  }
+#endif
+}
+
+/**
+ * Opens the cache file if it is the one of the image, maps it (or reads it, where it can not be mapped).
+ * @return false if there is no usable cache.
+ */
+bool CachedImage::open(const std::string &cachePath, const uint64_t sourceSize, const uint32_t sourceHash,
+                       const bool normalize, const double cutoff){
+  FILE *file=fopen(cachePath.c_str(),"rb");
+  if(!file){
+    return false;
+  }
+  CacheHeader header;
+  memset(&header,0,sizeof(header));
+  bool valid=fread(&header,sizeof(header),1,file)==1&&memcmp(header.magic,CACHE_MAGIC,8)==0&&
+    header.version==CACHE_VERSION&&header.normalized==(normalize?1u:0u)&&header.sourceSize==sourceSize&&
+    header.sourceHash==sourceHash&&header.nrow>0&&header.ncol>0&&header.cutoff<=cutoff&&
+    header.seedCount<=(uint64_t)header.nrow*header.ncol;
+  const size_t pixels=(size_t)header.nrow*header.ncol;
+  const size_t size=sizeof(header)+pixels*sizeof(double)+header.seedCount*sizeof(int);
+  //a truncated (or overlong) file is caught here
+  if(valid){
+#ifdef _WIN32
+    valid=_fseeki64(file,0,SEEK_END)==0&&(uint64_t)_ftelli64(file)==size;
+#else
+    valid=fseeko(file,0,SEEK_END)==0&&(uint64_t)ftello(file)==size;
+#endif
+  }
+  if(!valid){
+    fclose(file);
+    return false;
+  }
+
+#ifndef _WIN32
+  void *map=mmap(0,size,PROT_READ,MAP_PRIVATE,fileno(file),0);
+  if(map!=MAP_FAILED){
+    map_=(const uint8_t*)map;
+    mapSize_=size;
+    intensities_=(const double*)(map_+sizeof(header));
+    seeds_=(const int*)(map_+sizeof(header)+pixels*sizeof(double));
+  }
+#endif
+  if(!map_){
+    intensityBuffer_.resize(pixels);
+    seedBuffer_.resize(header.seedCount);
+#ifdef _WIN32
+    valid=_fseeki64(file,sizeof(header),SEEK_SET)==0;
+#else
+    valid=fseeko(file,sizeof(header),SEEK_SET)==0;
+#endif
+    valid=valid&&fread(&intensityBuffer_[0],sizeof(double),pixels,file)==pixels&&
+      (seedBuffer_.empty()||fread(&seedBuffer_[0],sizeof(int),seedBuffer_.size(),file)==seedBuffer_.size());
+    intensities_=&intensityBuffer_[0];
+    seeds_=seedBuffer_.empty()?0:&seedBuffer_[0];
+  }
+  fclose(file);
+  //the seeds index the intensities, one that does not (a damaged file) would send the search out of the image
+  for(uint64_t i=0;valid&&i<header.seedCount;i++){
+    valid=(uint32_t)seeds_[i]<pixels;
+  }
+  if(!valid){
+    close();
+    return false;
+  }
+  nrow_=header.nrow;
+  ncol_=header.ncol;
+  seedCount_=seedsAbove(intensities_,seeds_,header.seedCount,cutoff);
+  return true;
+}
+
+/**
+ * Preprocesses the image in memory and writes the cache file, through a temporary file renamed into place, so that
+ * processes sharing a cache directory never see a partly written cache.
+ */
+void CachedImage::build(const std::string &imagePath, const std::string &cachePath, const uint64_t sourceSize,
+                        const uint32_t sourceHash, const bool normalize, const double cutoff){
+  close();
+  TiffImage tiff(imagePath,true);
+  nrow_=tiff.height();
+  ncol_=tiff.width();
+  intensityBuffer_.resize((size_t)nrow_*ncol_);
+  tiff.sumChannels(&intensityBuffer_[0]);
+  if(normalize){
+    normalizeIntensities(&intensityBuffer_[0],intensityBuffer_.size());
+  }
+  sortSeeds(&intensityBuffer_[0],intensityBuffer_.size(),cutoff,seedBuffer_);
+  intensities_=&intensityBuffer_[0];
+  seeds_=seedBuffer_.empty()?0:&seedBuffer_[0];
+  seedCount_=seedBuffer_.size();
+
+  CacheHeader header;
+  memset(&header,0,sizeof(header));
+  memcpy(header.magic,CACHE_MAGIC,8);
+  header.version=CACHE_VERSION;
+  header.normalized=normalize?1:0;
+  header.sourceSize=sourceSize;
+  header.sourceHash=sourceHash;
+  header.nrow=nrow_;
+  header.ncol=ncol_;
+  header.cutoff=cutoff;
+  header.seedCount=seedCount_;
+
+  char suffix[64];
+  snprintf(suffix,sizeof(suffix),".%d.%p.tmp",(int)getpid(),(void*)this);
+  const std::string temporary=cachePath+suffix;
+  FILE *file=fopen(temporary.c_str(),"wb");
+  if(!file){
+    return;
+  }
+  bool written=fwrite(&header,sizeof(header),1,file)==1&&
+    fwrite(intensities_,sizeof(double),intensityBuffer_.size(),file)==intensityBuffer_.size()&&
+    (seedBuffer_.empty()||fwrite(seeds_,sizeof(int),seedBuffer_.size(),file)==seedBuffer_.size());
+  written=fclose(file)==0&&written;
+#ifdef _WIN32
+  if(written) remove(cachePath.c_str());
+#endif
+  if(!written||rename(temporary.c_str(),cachePath.c_str())!=0){
+    remove(temporary.c_str());
+  }
+}
+
+std::string cacheFileName(const std::string &directory, const std::string &imagePath){
+  const size_t slash=imagePath.find_last_of("/\\");
+  const std::string name=slash==std::string::npos?imagePath:imagePath.substr(slash+1);
+  const uint32_t hash=(uint32_t)crc32(0,(const Bytef*)imagePath.data(),imagePath.size());
+  char suffix[32];
+  snprintf(suffix,sizeof(suffix),".%08x.cache",hash);
+  return (directory.empty()?std::string("."):directory)+"/"+name+suffix;
+}
@@ -0,0 +1,88 @@
+/**
+ * @file
+ * Cache files of preprocessed images, plain C++. Decoding a TIFF, summing its channels, normalizing the
+ * intensities and sorting the seeds take longer than the search itself, and come out the same on every run over
+ * the same image, so they are done once and their result kept in a cache file next to the others: the intensities
+ * and the seeds in search order, laid out exactly as the search reads them, so that later runs memory-map the file
+ * and hand it to the search without decoding, sorting or even copying anything.
+ *
+ * A cache is keyed by the content of the image file (its size and CRC-32) and the preprocessing (whether the
+ * intensities are normalized), a cache of another or a changed image, a truncated one, or one written by another
+ * version or on a machine of another byte order, is rebuilt, as is one holding a seed outside the image (the seeds
+ * are checked on every load). The intensities are not checked, as that would take a pass over all of them. The
+ * seeds are kept in the order of sortSeeds(), which does not depend on the cutoff, so the seeds above a higher
+ * cutoff are a prefix of the cached ones and a cache serves every cutoff from the one it was built with up.
+ *
+ * The file starts with a 64 byte header, followed by the nrow*ncol intensities (doubles, column-major) and the
+ * seeds (32-bit 0-based column-major image indices), all in the byte order of the machine.
+ */
+#ifndef IMAGE_CACHE_H
+#define IMAGE_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+/**
+ * The preprocessed image and its seeds, read from the cache file or built (and written to it) if the cache is
+ * missing or stale. All the errors of reading the image are reported by throwing std::runtime_error, a cache file
+ * that can not be written is not an error, the image is then just preprocessed in memory.
+ */
+class CachedImage {
+public:
+  /**
+   * @param imagePath path to the TIFF image, its first page is read.
+   * @param cachePath path to the cache file.
+   * @param cutoff background intensity cutoff, the seeds are the pixels/dots at or above it.
+   * @param normalize whether to rescale the intensities to [0,1] (see normalizeIntensities()).
+   */
+  CachedImage(const std::string &imagePath, const std::string &cachePath, const double cutoff, const bool normalize);
+  ~CachedImage();
+
+  int nrow() const { return nrow_; }
+  int ncol() const { return ncol_; }
+  /**
+   * @return the column-major intensities, nrow()*ncol() values.
+   */
+  const double *intensities() const { return intensities_; }
+  /**
+   * @return the 0-based column-major image indices of the seeds, sorted as sortSeeds() sorts them.
+   */
+  const int *seeds() const { return seeds_; }
+  size_t seedCount() const { return seedCount_; }
+  /**
+   * @return true if the image was read from the cache, false if it was preprocessed anew.
+   */
+  bool reused() const { return reused_; }
+
+private:
+  CachedImage(const CachedImage&);
+  CachedImage& operator=(const CachedImage&);
+
+  bool open(const std::string &cachePath, const uint64_t sourceSize, const uint32_t sourceHash, const bool normalize,
+            const double cutoff);
+  void build(const std::string &imagePath, const std::string &cachePath, const uint64_t sourceSize,
+             const uint32_t sourceHash, const bool normalize, const double cutoff);
+  void close();
+
+  const uint8_t *map_;
+  size_t mapSize_;
+  std::vector<double> intensityBuffer_;
+  std::vector<int> seedBuffer_;
+  int nrow_;
+  int ncol_;
+  const double *intensities_;
+  const int *seeds_;
+  size_t seedCount_;
+  bool reused_;
+};
+
+/**
+ * @return the path of the cache file of an image in a cache directory: the file name of the image, followed by the
+ * CRC-32 of its whole path (so that images of the same name in different directories do not share a cache file)
+ * and the .cache extension.
+ */
+std::string cacheFileName(const std::string &directory, const std::string &imagePath);
+
+#endif
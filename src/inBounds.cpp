@@ -1,19 +1,128 @@
 #include <Rcpp.h>
+#include <limits.h>
 #include <stdio.h>
+#include <vector>
+
+#include "workerPool.h"
 using namespace Rcpp;
 
+/**
+ * Number of values a single thread checks at the least, smaller inputs are not worth spreading over threads.
+ */
+static const int VALUES_PER_THREAD=1<<16;
+
+/**
+ * Element-wise bounds check of a whole vector, the bounds being either scalars or vectors of the same length.
+ */
+struct BoundsCheck {
+  const double *x;
+  const double *left;
+  const double *right;
+  /**
+   * 1 for a vector of bounds, 0 for a scalar one.
+   */
+  R_xlen_t leftStep;
+  R_xlen_t rightStep;
+  bool inclusive;
+
+  /**
+   * @return 1 if x[i] falls inbetween the bounds, 0 if not, NA_LOGICAL if any of the values is missing.
+   */
+  int operator()(const R_xlen_t i) const {
+    const double v=x[i];
+    const double l=left[i*leftStep];
+    const double r=right[i*rightStep];
+    if(ISNAN(v)||ISNAN(l)||ISNAN(r)){
+      return NA_LOGICAL;
+    }
+    return inclusive?(v>=l&&v<=r):(v>l&&v<r);
+  }
+};
+
+/**
+ * Collects the 1-based indices of the values that fall inbetween the bounds, each thread those of its chunk.
+ * @param V the R vector type of the indices, NumericVector once they do not all fit in an int.
+ * @param T the element type of V.
+ */
+template<class V, class T>
+static V indicesIn(const BoundsCheck &check, const R_xlen_t count, const int threads, const R_xlen_t chunk,
+                   WorkerPool &pool){
+  std::vector<std::vector<T> > found(threads);
+  pool.run(threads,[&](const int, const int t){
+    const R_xlen_t end=std::min(count,(t+1)*chunk);
+    for(R_xlen_t i=t*chunk;i<end;i++){
+      if(check(i)==1){
+        found[t].push_back((T)(i+1));
+      }
+    }
+  });
+  size_t total=0;
+  for(int t=0;t<threads;t++){
+    total+=found[t].size();
+  }
+  V out(total);
+  T *result=out.begin();
+  for(int t=0;t<threads;t++){
+    result=std::copy(found[t].begin(),found[t].end(),result);
+  }
+  return out;
+}
+
+/**
+ * Rcpp export function, checks whether the values fall inbetween the bounds, element-wise.
+ * @param x numeric vector (or matrix) of values.
+ * @param leftBound left bound, a single value or one per value of x.
+ * @param rightBound right bound, a single value or one per value of x.
+ * @param inclusive whether the comparison is inclusive.
+ * @param whichIn whether to return the 1-based indices of the values that fall inbetween the bounds rather
+ * than a logical per value.
+ * @param nThreads number of threads to use for large inputs, values below 1 mean as many as there are hardware
+ * threads.
+ * @return a logical vector, NA where a value or a bound is missing, or a vector of indices, integer unless x is
+ * a long vector of more than INT_MAX values, numeric then.
+ */
 // [[Rcpp::export]]
-RcppExport SEXP inBounds( SEXP x, SEXP leftBound, SEXP rightBound, SEXP inclusive) {
-  
+RcppExport SEXP inBounds( SEXP x, SEXP leftBound, SEXP rightBound, SEXP inclusive, SEXP whichIn, SEXP nThreads) {
+BEGIN_RCPP
   const NumericVector xx(x);
   const NumericVector lb(leftBound);
   const NumericVector rb(rightBound);
   const LogicalVector incl(inclusive);
-
-  if(incl[0]){
-    return wrap(xx[0]>=lb[0]&&xx[0]<=rb[0]);
-  }else{
-    return wrap(xx[0]>lb[0]&&xx[0]<rb[0]);
+  const bool which=as<bool>(whichIn);
+  
+  const R_xlen_t count=xx.size();
+  if((lb.size()!=1&&lb.size()!=count)||(rb.size()!=1&&rb.size()!=count)){
+    stop("the bounds must be single values or as long as x");
+  }
+  
+  BoundsCheck check;
+  check.x=xx.begin();
+  check.left=lb.begin();
+  check.right=rb.begin();
+  check.leftStep=lb.size()==1?0:1;
+  check.rightStep=rb.size()==1?0:1;
+  check.inclusive=incl[0];
+  
+  const int threads=(int)std::max<R_xlen_t>(1,std::min<R_xlen_t>(resolveThreads(as<int>(nThreads)),
+                                                                  count/VALUES_PER_THREAD));
+  const R_xlen_t chunk=(count+threads-1)/threads;
+  WorkerPool pool(threads);
+  
+  if(!which){
+    LogicalVector out(count);
+    int *result=out.begin();
+    pool.run(threads,[&](const int, const int t){
+      const R_xlen_t end=std::min(count,(t+1)*chunk);
+      for(R_xlen_t i=t*chunk;i<end;i++){
+        result[i]=check(i);
+      }
+    });
+    return out;
   }
   
+  if(count>INT_MAX){
+    return indicesIn<NumericVector,double>(check,count,threads,chunk,pool);
+  }
+  return indicesIn<IntegerVector,int>(check,count,threads,chunk,pool);
+END_RCPP
 }
@@ -0,0 +1,273 @@
+#include <limits.h>
+#include <algorithm>
+
+#include "incrementalSearch.h"
+
+/**
+ * Owner of the pixels/dots no cluster took.
+ */
+static const int FREE=INT_MAX;
+
+/**
+ * Claims pixels/dots for the cluster of a given rank: a pixel/dot is free for it unless a cluster of an earlier
+ * rank took it.
+ */
+struct OwnerClaims {
+  const PixelField &field;
+  std::vector<int> &owner;
+  int rank;
+  /**
+   * receives the ranks of the clusters that had taken the pixels/dots claimed.
+   */
+  std::vector<int> &displaced;
+  OwnerClaims(const PixelField &field, std::vector<int> &owner, const int rank, std::vector<int> &displaced)
+    :field(field),owner(owner),rank(rank),displaced(displaced){}
+  bool available(const int index) const { return field.bright(index)&&owner[index]>rank; }
+  void claim(const int index) {
+    if(owner[index]!=FREE){
+      displaced.push_back(owner[index]);
+    }
+    owner[index]=rank;
+  }
+};
+
+/**
+ * Tells the seeds at least as bright as a cutoff.
+ */
+struct Brighter {
+  const double *intensities;
+  double cutoff;
+  Brighter(const double *intensities, const double cutoff):intensities(intensities),cutoff(cutoff){}
+  bool operator()(const int pixel) const { return intensities[pixel]>=cutoff; }
+};
+
+/**
+ * Replays the seeds, specialized by dispatchKernel().
+ */
+struct ReplayKernel {
+  IncrementalSearch &search;
+  int replayed;
+  ReplayKernel(IncrementalSearch &search):search(search),replayed(0){}
+  template<int Connectivity, class Acceptance>
+  void run(const Acceptance &acceptance){ replayed=search.replay<Connectivity>(acceptance); }
+};
+
+IncrementalSearch::IncrementalSearch(const double *intensities, const int nrow, const int ncol,
+                                     const ClusterParams &params)
+  :intensities_(intensities,intensities+(size_t)nrow*ncol),params_(params),
+   field_(&intensities_[0],nrow,ncol,params.cutoff),updating_(false){
+  sortSeeds(&intensities_[0],nrow*ncol,0,order_);
+  seedCount_=std::partition_point(order_.begin(),order_.end(),Brighter(&intensities_[0],params_.cutoff))
+    -order_.begin();
+  owner_.assign((size_t)field_.stride()*(ncol+2),FREE);
+
+  rankOf_.assign(owner_.size(),INT_MAX);
+  for(size_t r=0;r<order_.size();r++){
+    rankOf_[field_.fieldIndex(order_[r])]=r;
+  }
+  inCluster_.assign(owner_.size(),0);
+  queued_.assign(order_.size(),0);
+
+  ReplayKernel kernel(*this);
+  dispatchKernel(params_,kernel);
+  updating_=true;
+}
+
+void IncrementalSearch::touch(const int rank){
+  if(updating_&&reportedBefore_.find(rank)==reportedBefore_.end()){
+    std::unordered_map<int,std::vector<int> >::const_iterator cluster=clusters_.find(rank);
+    reportedBefore_[rank]=cluster!=clusters_.end()&&params_.acceptable(cluster->second.size());
+  }
+}
+
+void IncrementalSearch::queue(const int rank, const int after){
+  if(rank>after&&rank<seedCount_&&!queued_[rank]){
+    queued_[rank]=1;
+    queuedRanks_.push_back(rank);
+    queue_.push(rank);
+  }
+}
+
+/**
+ * Replays, after the given time (rank), the seeds that may have asked about a pixel/dot: its own seed and the
+ * clusters holding it or one of its neighbors.
+ */
+void IncrementalSearch::markDirty(const int pos, const int time){
+  queue(rankOf_[pos],time);
+  queue(owner_[pos],time);
+  for(int d=0;d<params_.connectivity;d++){
+    queue(owner_[pos+NEIGHBOR_DX[d]+NEIGHBOR_DY[d]*field_.stride()],time);
+  }
+}
+
+void IncrementalSearch::dropCluster(const int rank){
+  std::unordered_map<int,std::vector<int> >::iterator cluster=clusters_.find(rank);
+  if(cluster==clusters_.end()){
+    return;
+  }
+  touch(rank);
+  const std::vector<int> &pixels=cluster->second;
+  for(size_t i=0;i<pixels.size();i++){
+    if(owner_[pixels[i]]==rank){
+      owner_[pixels[i]]=FREE;
+    }
+    if(updating_){
+      markDirty(pixels[i],rank);
+    }
+  }
+  clusters_.erase(cluster);
+}
+
+/**
+ * Replays the seed of a rank: grows its cluster against the current claims and, if it comes out different
+ * from the one grown before, makes the pixels/dots it lost or gained dirty for the later seeds.
+ */
+template<int Connectivity, class Acceptance>
+void IncrementalSearch::process(const int rank, const Acceptance &acceptance){
+  const int seed=field_.fieldIndex(order_[rank]);
+  if(rank>=seedCount_||owner_[seed]<rank){
+    dropCluster(rank);
+    return;
+  }
+
+  std::vector<int> before;
+  std::unordered_map<int,std::vector<int> >::iterator cluster=clusters_.find(rank);
+  if(cluster!=clusters_.end()){
+    before.swap(cluster->second);
+    for(size_t i=0;i<before.size();i++){
+      if(owner_[before[i]]==rank){
+        owner_[before[i]]=FREE;
+      }
+    }
+  }
+
+  displaced_.clear();
+  OwnerClaims claims(field_,owner_,rank,displaced_);
+  growCluster<Connectivity>(field_,claims,acceptance,seed,stack_,output_,0);
+
+  if(cluster!=clusters_.end()){
+    //the old cluster goes back in place for touch() to read its size from
+    cluster->second.swap(before);
+    if(cluster->second==output_){
+      return;
+    }
+  }
+  touch(rank);
+  if(updating_){
+    const std::vector<int> &old=cluster!=clusters_.end()?cluster->second:before;
+    for(size_t i=0;i<displaced_.size();i++){
+      queue(displaced_[i],rank);
+    }
+    for(size_t i=0;i<old.size();i++){
+      inCluster_[old[i]]=1;
+    }
+    for(size_t i=0;i<output_.size();i++){
+      if(!inCluster_[output_[i]]){
+        markDirty(output_[i],rank);
+      }
+    }
+    for(size_t i=0;i<old.size();i++){
+      inCluster_[old[i]]=0;
+      if(owner_[old[i]]!=rank){
+        markDirty(old[i],rank);
+      }
+    }
+  }
+  clusters_[rank]=output_;
+}
+
+/**
+ * Grows all the seeds on the first run, the queued ones (in rank order) on an update.
+ * @return the number of seeds grown.
+ */
+template<int Connectivity, class Acceptance>
+int IncrementalSearch::replay(const Acceptance &acceptance){
+  if(!updating_){
+    for(int r=0;r<seedCount_;r++){
+      process<Connectivity>(r,acceptance);
+    }
+    return seedCount_;
+  }
+  int replayed=0;
+  while(!queue_.empty()){
+    const int rank=queue_.top();
+    queue_.pop();
+    process<Connectivity>(rank,acceptance);
+    replayed++;
+  }
+  return replayed;
+}
+
+int IncrementalSearch::setCutoff(const double cutoff, std::vector<ClusterChange> &changes){
+  changes.clear();
+  const int before=seedCount_;
+  const int after=std::partition_point(order_.begin(),order_.end(),Brighter(&intensities_[0],cutoff))-order_.begin();
+  params_.cutoff=cutoff;
+  seedCount_=after;
+
+  //the pixels/dots crossing the cutoff
+  const int low=std::min(before,after);
+  const int high=std::max(before,after);
+  for(int r=low;r<high;r++){
+    field_.setBright(field_.fieldIndex(order_[r]),r<after);
+  }
+  //the seeds that are gone do not affect any seed left, all of them are brighter
+  for(int r=after;r<before;r++){
+    dropCluster(r);
+  }
+  for(int r=low;r<high;r++){
+    markDirty(field_.fieldIndex(order_[r]),-1);
+  }
+
+  ReplayKernel kernel(*this);
+  dispatchKernel(params_,kernel);
+  const int replayed=kernel.replayed;
+
+  for(size_t i=0;i<queuedRanks_.size();i++){
+    queued_[queuedRanks_[i]]=0;
+  }
+  queuedRanks_.clear();
+
+  std::vector<int> touched;
+  for(std::unordered_map<int,bool>::const_iterator i=reportedBefore_.begin();i!=reportedBefore_.end();++i){
+    touched.push_back(i->first);
+  }
+  std::sort(touched.begin(),touched.end());
+  for(size_t i=0;i<touched.size();i++){
+    const int rank=touched[i];
+    std::unordered_map<int,std::vector<int> >::const_iterator cluster=clusters_.find(rank);
+    const bool reported=cluster!=clusters_.end()&&params_.acceptable(cluster->second.size());
+    const bool wasReported=reportedBefore_[rank];
+    if(reported&&!wasReported){
+      changes.push_back(ClusterChange(ClusterChange::ADDED,rank));
+    }else if(!reported&&wasReported){
+      changes.push_back(ClusterChange(ClusterChange::REMOVED,rank));
+    }else if(reported){
+      changes.push_back(ClusterChange(ClusterChange::CHANGED,rank));
+    }
+  }
+  reportedBefore_.clear();
+  return replayed;
+}
+
+std::vector<int> IncrementalSearch::reportedRanks() const {
+  std::vector<int> ranks;
+  for(std::unordered_map<int,std::vector<int> >::const_iterator i=clusters_.begin();i!=clusters_.end();++i){
+    if(params_.acceptable(i->second.size())){
+      ranks.push_back(i->first);
+    }
+  }
+  std::sort(ranks.begin(),ranks.end());
+  return ranks;
+}
+
+std::vector<int> IncrementalSearch::clusterPixels(const int rank) const {
+  std::vector<int> pixels;
+  std::unordered_map<int,std::vector<int> >::const_iterator cluster=clusters_.find(rank);
+  if(cluster!=clusters_.end()){
+    for(size_t i=0;i<cluster->second.size();i++){
+      pixels.push_back(field_.imageIndex(cluster->second[i]));
+    }
+  }
+  return pixels;
+}
@@ -0,0 +1,137 @@
+/**
+ * @file
+ * A cluster search that is kept alive between cutoff changes, plain C++. Since the seeds of a cutoff are exactly
+ * the positive pixels/dots at least as bright as it, all the positive pixels/dots are sorted once, and the seeds
+ * of any cutoff are a prefix of that order: a pixel/dot keeps its rank (its position in the order) whatever the
+ * cutoff is, and the clusters are identified by the ranks of their seeds.
+ *
+ * Every pixel/dot records the rank of the cluster that took it. The expansion of a seed only ever asks about
+ * the seed itself and the neighbors of the pixels/dots it accepts, so as long as none of the answers change,
+ * it grows exactly the same cluster as before. When the cutoff changes, the pixels/dots crossing it are dirty,
+ * and the seeds that may have asked about them are replayed in rank order: the seed at a dirty pixel/dot and the
+ * seeds of the clusters that own it or any of its neighbors. A pixel/dot is free for the seed of rank r if nobody
+ * took it or a cluster of a later rank did (which has not grown yet at that point of the search). A replayed
+ * cluster that comes out different from before makes the pixels/dots it lost or gained dirty for the seeds after
+ * it, and a cluster it took pixels/dots from is replayed as well. Everything else is left alone, and the outcome
+ * is identical to a search from scratch with the new cutoff.
+ */
+#ifndef INCREMENTAL_SEARCH_H
+#define INCREMENTAL_SEARCH_H
+
+#include <vector>
+#include <queue>
+#include <functional>
+#include <unordered_map>
+
+#include "clusterSearch.h"
+
+/**
+ * A change of a reported cluster, caused by a cutoff change.
+ */
+struct ClusterChange {
+  enum Kind { ADDED, REMOVED, CHANGED };
+  Kind kind;
+  /**
+   * rank of the seed of the cluster.
+   */
+  int rank;
+  ClusterChange(const Kind kind, const int rank):kind(kind),rank(rank){}
+};
+
+class IncrementalSearch {
+public:
+  /**
+   * Copies the image and searches it with the initial parameters.
+   * @param intensities column-major image intensities, nrow*ncol values.
+   * @param nrow number of rows in the image.
+   * @param ncol number of columns in the image.
+   * @param params the search parameters.
+   */
+  IncrementalSearch(const double *intensities, const int nrow, const int ncol, const ClusterParams &params);
+
+  const ClusterParams &params() const { return params_; }
+  int nrow() const { return field_.nrow(); }
+
+  /**
+   * Searches the image again with another cutoff, re-growing only the clusters that may have changed.
+   * @param cutoff the new cutoff.
+   * @param changes receives the changes of the reported (acceptably sized) clusters, by rank.
+   * @return the number of seeds that were replayed.
+   */
+  int setCutoff(const double cutoff, std::vector<ClusterChange> &changes);
+
+  /**
+   * @return the ranks of the seeds of the reported clusters, ascending (the order of getClusters).
+   */
+  std::vector<int> reportedRanks() const;
+  /**
+   * @param rank rank of the seed of a cluster.
+   * @return its pixels/dots as 0-based column-major image indices, in the order of getClusters.
+   */
+  std::vector<int> clusterPixels(const int rank) const;
+  /**
+   * @return 0-based column-major image index of the pixel/dot of the given rank.
+   */
+  int rankPixel(const int rank) const { return order_[rank]; }
+
+private:
+  friend struct ReplayKernel;
+  template<int Connectivity, class Acceptance>
+  int replay(const Acceptance &acceptance);
+  template<int Connectivity, class Acceptance>
+  void process(const int rank, const Acceptance &acceptance);
+  void dropCluster(const int rank);
+  void touch(const int rank);
+  void markDirty(const int pos, const int time);
+  void queue(const int rank, const int after);
+
+  std::vector<double> intensities_;
+  ClusterParams params_;
+  PixelField field_;
+  /**
+   * all the positive pixels/dots, brightest first (the seeds of any cutoff are a prefix).
+   */
+  std::vector<int> order_;
+  /**
+   * number of seeds of the current cutoff.
+   */
+  int seedCount_;
+  /**
+   * rank of the cluster that took a pixel/dot (by field index), FREE if none did.
+   */
+  std::vector<int> owner_;
+  /**
+   * the pixels/dots (field indices) of every cluster grown, reported or not, by the rank of its seed.
+   */
+  std::unordered_map<int,std::vector<int> > clusters_;
+
+  /**
+   * rank of every pixel/dot (by field index), INT_MAX for the ones that are not positive.
+   */
+  std::vector<int> rankOf_;
+  /**
+   * scratch flags (by field index) of the pixels/dots of the cluster being replayed.
+   */
+  std::vector<char> inCluster_;
+
+  std::priority_queue<int,std::vector<int>,std::greater<int> > queue_;
+  std::vector<char> queued_;
+  std::vector<int> queuedRanks_;
+  /**
+   * ranks of the later clusters the cluster being grown took pixels/dots from.
+   */
+  std::vector<int> displaced_;
+  /**
+   * whether the search is updating (tracking the changes) rather than running for the first time.
+   */
+  bool updating_;
+  /**
+   * the clusters changed by the current update, by rank, along with whether they were reported before it.
+   */
+  std::unordered_map<int,bool> reportedBefore_;
+
+  std::vector<ExpansionFrame> stack_;
+  std::vector<int> output_;
+};
+
+#endif
@@ -0,0 +1,242 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <stdexcept>
+#include <zlib.h>
+
+#include "overlayImage.h"
+
+/**
+ * @return the channel of a 0xRRGGBB colour, shift being 16 for red, 8 for green and 0 for blue.
+ */
+static int channel(const uint32_t colour, const int shift){
+  return (colour>>shift)&0xFF;
+}
+
+static void paint(uint8_t *pixel, const uint32_t colour){
+  pixel[0]=channel(colour,16);
+  pixel[1]=channel(colour,8);
+  pixel[2]=channel(colour,0);
+}
+
+void renderOverlay(const double *intensities, const int nrow, const int ncol, const int *labels,
+                   const OverlayStyle &style, std::vector<uint8_t> &rgb){
+  const size_t size=(size_t)nrow*ncol;
+  double min=INFINITY;
+  double max=-INFINITY;
+  int maxLabel=0;
+  for(size_t i=0;i<size;i++){
+    if(intensities[i]<min) min=intensities[i];
+    if(intensities[i]>max) max=intensities[i];
+    if(labels[i]>maxLabel) maxLabel=labels[i];
+  }
+  const double range=max>min?max-min:1;
+
+  //the picture is written row by row, the sums of the coordinates of the clusters along the way
+  std::vector<int> area(maxLabel+1,0);
+  std::vector<double> sumX(maxLabel+1,0);
+  std::vector<double> sumY(maxLabel+1,0);
+  rgb.resize(size*3);
+  uint8_t *pixel=rgb.empty()?0:&rgb[0];
+  for(int x=0;x<nrow;x++){
+    for(int y=0;y<ncol;y++,pixel+=3){
+      const size_t i=x+(size_t)y*nrow;
+      const int label=labels[i];
+      if(label>0){
+        area[label]++;
+        sumX[label]+=x;
+        sumY[label]+=y;
+        if(x==0||x==nrow-1||y==0||y==ncol-1||labels[i-1]!=label||labels[i+1]!=label||labels[i-nrow]!=label||
+           labels[i+nrow]!=label){
+          paint(pixel,style.outline);
+          continue;
+        }
+      }
+      double t=(intensities[i]-min)/range;
+      if(!(t>0)) t=0;
+      if(t>1) t=1;
+      for(int c=0;c<3;c++){
+        const int low=channel(style.low,16-8*c);
+        const int high=channel(style.high,16-8*c);
+        pixel[c]=(uint8_t)lround(low+t*(high-low));
+      }
+    }
+  }
+
+  for(int label=1;label<=maxLabel&&style.markerSize>0;label++){
+    if(area[label]==0){
+      continue;
+    }
+    const int cx=(int)lround(sumX[label]/area[label]);
+    const int cy=(int)lround(sumY[label]/area[label]);
+    for(int d=-style.markerSize;d<=style.markerSize;d++){
+      if(cx+d>=0&&cx+d<nrow){
+        paint(&rgb[((size_t)(cx+d)*ncol+cy)*3],style.marker);
+      }
+      if(cy+d>=0&&cy+d<ncol){
+        paint(&rgb[((size_t)cx*ncol+cy+d)*3],style.marker);
+      }
+    }
+  }
+}
+
+void renderOverlay(const double *intensities, const int nrow, const int ncol, const ClusterSet &clusters,
+                   const OverlayStyle &style, std::vector<uint8_t> &rgb){
+  std::vector<int> labels((size_t)nrow*ncol,0);
+  for(size_t i=0;i<clusters.size();i++){
+    for(size_t j=clusters.offsets[i];j<clusters.offsets[i+1];j++){
+      labels[clusters.pixels[j]]=i+1;
+    }
+  }
+  renderOverlay(intensities,nrow,ncol,labels.empty()?0:&labels[0],style,rgb);
+}
+
+static void put16(std::vector<uint8_t> &out, const unsigned value){
+  out.push_back(value&0xFF);
+  out.push_back((value>>8)&0xFF);
+}
+
+static void put32(std::vector<uint8_t> &out, const uint32_t value){
+  put16(out,value&0xFFFF);
+  put16(out,value>>16);
+}
+
+static void putBigEndian32(std::vector<uint8_t> &out, const uint32_t value){
+  out.push_back(value>>24);
+  out.push_back((value>>16)&0xFF);
+  out.push_back((value>>8)&0xFF);
+  out.push_back(value&0xFF);
+}
+
+/**
+ * Appends a PNG chunk: its length, type, data and CRC.
+ */
+static void putChunk(std::vector<uint8_t> &out, const char *type, const uint8_t *data, const size_t size){
+  putBigEndian32(out,size);
+  const size_t start=out.size();
+  out.insert(out.end(),type,type+4);
+  out.insert(out.end(),data,data+size);
+  putBigEndian32(out,crc32(0,&out[start],size+4));
+}
+
+/**
+ * Encodes the picture as a PNG, the rows unfiltered.
+ */
+static void encodePng(const std::vector<uint8_t> &rgb, const int width, const int height, std::vector<uint8_t> &out){
+  const size_t rowBytes=(size_t)width*3;
+  std::vector<uint8_t> raw(height*(rowBytes+1));
+  for(int r=0;r<height;r++){
+    raw[r*(rowBytes+1)]=0;
+    std::copy(rgb.begin()+r*rowBytes,rgb.begin()+(r+1)*rowBytes,raw.begin()+r*(rowBytes+1)+1);
+  }
+  uLongf compressedSize=compressBound(raw.size());
+  std::vector<uint8_t> compressed(compressedSize);
+  if(compress2(&compressed[0],&compressedSize,&raw[0],raw.size(),6)!=Z_OK){
+    throw std::runtime_error("can not compress the overlay");
+  }
+
+  static const uint8_t signature[8]={0x89,'P','N','G','\r','\n',0x1A,'\n'};
+  out.assign(signature,signature+8);
+  std::vector<uint8_t> header;
+  putBigEndian32(header,width);
+  putBigEndian32(header,height);
+  const uint8_t format[5]={8,2,0,0,0}; //8-bit RGB, no interlace
+  header.insert(header.end(),format,format+5);
+  putChunk(out,"IHDR",&header[0],header.size());
+  //chunks are limited to 2^31-1 bytes, the compressed data of a large mosaic is split over several
+  static const size_t MAX_CHUNK=(size_t)1<<30;
+  for(size_t offset=0;offset<compressedSize;offset+=MAX_CHUNK){
+    putChunk(out,"IDAT",&compressed[0]+offset,std::min(MAX_CHUNK,(size_t)compressedSize-offset));
+  }
+  putChunk(out,"IEND",0,0);
+}
+
+/**
+ * Appends a TIFF directory entry of a single value.
+ */
+static void putEntry(std::vector<uint8_t> &out, const unsigned tag, const unsigned type, const uint32_t count,
+                     const uint32_t value){
+  put16(out,tag);
+  put16(out,type);
+  put32(out,count);
+  if(type==3&&count==1){
+    put16(out,value);
+    put16(out,0);
+  }else{
+    put32(out,value);
+  }
+}
+
+/**
+ * Builds the header and the directory of a little-endian TIFF holding the picture in a single strip right after
+ * them.
+ */
+static void tiffHeader(const int width, const int height, std::vector<uint8_t> &out){
+  static const unsigned SHORT=3;
+  static const unsigned LONG=4;
+  static const unsigned ENTRIES=10;
+  const uint32_t bitsOffset=8+2+ENTRIES*12+4;
+  const uint32_t dataOffset=bitsOffset+6;
+  out.clear();
+  out.push_back('I');
+  out.push_back('I');
+  put16(out,42);
+  put32(out,8);
+  put16(out,ENTRIES);
+  putEntry(out,256,LONG,1,width);
+  putEntry(out,257,LONG,1,height);
+  putEntry(out,258,SHORT,3,bitsOffset);
+  putEntry(out,259,SHORT,1,1); //no compression
+  putEntry(out,262,SHORT,1,2); //RGB
+  putEntry(out,273,LONG,1,dataOffset);
+  putEntry(out,277,SHORT,1,3);
+  putEntry(out,278,LONG,1,height);
+  putEntry(out,279,LONG,1,(uint32_t)width*height*3);
+  putEntry(out,284,SHORT,1,1); //chunky
+  put32(out,0);
+  for(int c=0;c<3;c++){
+    put16(out,8);
+  }
+}
+
+/**
+ * @return true if the path ends with the suffix, ignoring the case.
+ */
+static bool endsWith(const std::string &path, const std::string &suffix){
+  if(path.size()<suffix.size()){
+    return false;
+  }
+  for(size_t i=0;i<suffix.size();i++){
+    if(tolower(path[path.size()-suffix.size()+i])!=suffix[i]) return false;
+  }
+  return true;
+}
+
+void writeOverlay(const std::string &path, const std::vector<uint8_t> &rgb, const int width, const int height){
+  const bool tiff=endsWith(path,".tif")||endsWith(path,".tiff");
+  if(tiff&&(double)width*height*3>UINT32_MAX-1024){
+    throw std::runtime_error("the overlay is too large for a TIFF, write a PNG instead");
+  }
+  std::vector<uint8_t> header;
+  std::vector<uint8_t> png;
+  const std::vector<uint8_t> *body;
+  if(tiff){
+    tiffHeader(width,height,header);
+    body=&rgb;
+  }else{
+    encodePng(rgb,width,height,png);
+    body=&png;
+  }
+
+  FILE *file=fopen(path.c_str(),"wb");
+  if(!file){
+    throw std::runtime_error("can not open "+path+" for writing");
+  }
+  bool written=header.empty()||fwrite(&header[0],1,header.size(),file)==header.size();
+  written=written&&(body->empty()||fwrite(&(*body)[0],1,body->size(),file)==body->size());
+  written=fclose(file)==0&&written;
+  if(!written){
+    throw std::runtime_error("can not write "+path);
+  }
+}
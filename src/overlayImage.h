@@ -0,0 +1,62 @@
+/**
+ * @file
+ * Overlay rendering of the clusters found in an image, plain C++. The intensities are colour-mapped (from a low to
+ * a high colour over their range, as scale_fill_gradient does), the pixels/dots on the border of a cluster are
+ * painted in an outline colour and a cross marks the centre of every cluster. The picture is written as an 8-bit
+ * RGB PNG (Deflate compressed with zlib) or an uncompressed baseline TIFF, image row x being picture row x.
+ */
+#ifndef OVERLAY_IMAGE_H
+#define OVERLAY_IMAGE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "clusterSearch.h"
+
+/**
+ * Colours and marker size of an overlay, the colours given as 0xRRGGBB.
+ */
+struct OverlayStyle {
+  uint32_t low;
+  uint32_t high;
+  uint32_t outline;
+  uint32_t marker;
+  /**
+   * half the length of the arms of a centre marker in pixels/dots, 0 for no markers.
+   */
+  int markerSize;
+  OverlayStyle():low(0x000000),high(0x00FF00),outline(0xFFFF00),marker(0xFF0000),markerSize(3){}
+};
+
+/**
+ * Renders an overlay.
+ * @param intensities column-major image intensities, nrow*ncol values.
+ * @param nrow number of rows in the image.
+ * @param ncol number of columns in the image.
+ * @param labels column-major cluster labels, nrow*ncol values: 0 for the pixels/dots outside any cluster, i for the
+ * ones of cluster i (1-based). The centre of a cluster is the mean of the coordinates of its pixels/dots.
+ * @param style the colours and the marker size.
+ * @param rgb receives the picture, row after row, 3 bytes per pixel/dot.
+ */
+void renderOverlay(const double *intensities, const int nrow, const int ncol, const int *labels,
+                   const OverlayStyle &style, std::vector<uint8_t> &rgb);
+
+/**
+ * Renders the overlay of clusters.
+ * @param clusters the clusters, the pixels/dots given as 0-based column-major image indices.
+ */
+void renderOverlay(const double *intensities, const int nrow, const int ncol, const ClusterSet &clusters,
+                   const OverlayStyle &style, std::vector<uint8_t> &rgb);
+
+/**
+ * Writes a picture rendered by renderOverlay(), as a TIFF if the path ends with .tif or .tiff (in any case), as a
+ * PNG otherwise. Throws std::runtime_error if the file can not be written.
+ * @param path path to the file.
+ * @param rgb the picture, row after row, 3 bytes per pixel/dot.
+ * @param width the width of the picture (the number of image columns).
+ * @param height the height of the picture (the number of image rows).
+ */
+void writeOverlay(const std::string &path, const std::vector<uint8_t> &rgb, const int width, const int height);
+
+#endif
@@ -0,0 +1,89 @@
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#include "pointDistance.h"
+#include "workerPool.h"
+
+/**
+ * Number of points handled by one work item.
+ */
+static const int POINTS_PER_ITEM=64;
+
+/**
+ * Accumulates the squared distances from a single point to all the points of a set.
+ * @param set the points.
+ * @param point coordinates of the single point, set.dims values.
+ * @param out receives set.count squared distances.
+ */
+static void squaredDistances(const PointSet &set, const double *point, double *out){
+  std::fill(out,out+set.count,0.0);
+  for(int d=0;d<set.dims;d++){
+    const double *column=set.coords+(long long)d*set.count;
+    const double p=point[d];
+    for(int i=0;i<set.count;i++){
+      const double diff=column[i]-p;
+      out[i]+=diff*diff;
+    }
+  }
+}
+
+void crossDistances(const PointSet &a, const PointSet &b, const int threads, double *out){
+  const int items=(b.count+POINTS_PER_ITEM-1)/POINTS_PER_ITEM;
+  WorkerPool pool(std::min(resolveThreads(threads),std::max(1,items)));
+  pool.run(items,[&](const int, const int item){
+    std::vector<double> point(b.dims);
+    const int end=std::min(b.count,(item+1)*POINTS_PER_ITEM);
+    for(int j=item*POINTS_PER_ITEM;j<end;j++){
+      for(int d=0;d<b.dims;d++){
+        point[d]=b.at(j,d);
+      }
+      double *column=out+(long long)j*a.count;
+      squaredDistances(a,&point[0],column);
+      for(int i=0;i<a.count;i++){
+        column[i]=sqrt(column[i]);
+      }
+    }
+  });
+}
+
+/**
+ * Orders candidate neighbors by squared distance, then by index.
+ */
+struct Closer {
+  const double *squared;
+  Closer(const double *squared):squared(squared){}
+  bool operator()(const int i, const int j) const {
+    return squared[i]<squared[j]||(squared[i]==squared[j]&&i<j);
+  }
+};
+
+void nearestNeighbors(const PointSet &a, const PointSet &b, const int k, const bool excludeSelf, const int threads,
+                      int *index, double *distance){
+  const int items=(a.count+POINTS_PER_ITEM-1)/POINTS_PER_ITEM;
+  WorkerPool pool(std::min(resolveThreads(threads),std::max(1,items)));
+  pool.run(items,[&](const int, const int item){
+    std::vector<double> point(a.dims);
+    std::vector<double> squared(b.count);
+    std::vector<int> candidates;
+    const int end=std::min(a.count,(item+1)*POINTS_PER_ITEM);
+    for(int i=item*POINTS_PER_ITEM;i<end;i++){
+      for(int d=0;d<a.dims;d++){
+        point[d]=a.at(i,d);
+      }
+      squaredDistances(b,&point[0],&squared[0]);
+      candidates.clear();
+      for(int j=0;j<b.count;j++){
+        if(!excludeSelf||j!=i){
+          candidates.push_back(j);
+        }
+      }
+      const Closer closer(&squared[0]);
+      std::partial_sort(candidates.begin(),candidates.begin()+k,candidates.end(),closer);
+      for(int n=0;n<k;n++){
+        index[i+(long long)n*a.count]=candidates[n];
+        distance[i+(long long)n*a.count]=sqrt(squared[candidates[n]]);
+      }
+    }
+  });
+}
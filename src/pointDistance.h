@@ -0,0 +1,44 @@
+/**
+ * @file
+ * Distances between whole sets of points (cell centres, for instance), plain C++. The points are given as
+ * column-major coordinate matrices, one row per point, one column per dimension, so that the inner loops run
+ * over one coordinate of many points at a time, contiguous in memory, which the compiler vectorizes.
+ */
+#ifndef POINT_DISTANCE_H
+#define POINT_DISTANCE_H
+
+/**
+ * A column-major coordinate matrix, one row per point.
+ */
+struct PointSet {
+  const double *coords;
+  int count;
+  int dims;
+  PointSet(const double *coords, const int count, const int dims):coords(coords),count(count),dims(dims){}
+  double at(const int i, const int d) const { return coords[i+(long long)d*count]; }
+};
+
+/**
+ * Computes the Euclidean distances between every point of a and every point of b.
+ * @param a the first set of points.
+ * @param b the second set of points, of the same dimension.
+ * @param threads the number of threads to use, values below 1 mean as many as there are hardware threads.
+ * @param out receives the distances as a column-major a.count*b.count matrix.
+ */
+void crossDistances(const PointSet &a, const PointSet &b, const int threads, double *out);
+
+/**
+ * Finds the k nearest points of b to every point of a, by brute force.
+ * @param a the query points.
+ * @param b the points to search, of the same dimension.
+ * @param k the number of neighbors to find, not more than the number of points of b (less one if excludeSelf).
+ * @param excludeSelf whether a and b are the same set, in which case a point is not its own neighbor.
+ * @param threads the number of threads to use, values below 1 mean as many as there are hardware threads.
+ * @param index receives the 0-based indices of the neighbors in b as a column-major a.count*k matrix, nearest
+ * first (ties broken by the index).
+ * @param distance receives the distances to the neighbors, in the same layout.
+ */
+void nearestNeighbors(const PointSet &a, const PointSet &b, const int k, const bool excludeSelf, const int threads,
+                      int *index, double *distance);
+
+#endif
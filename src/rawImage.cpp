@@ -0,0 +1,116 @@
+#include <string.h>
+#include <stdexcept>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#include "rawImage.h"
+
+static void fail(const std::string &message){
+  throw std::runtime_error(message);
+}
+
+RawImage::RawImage(const std::string &path, const int nrow, const int ncol, const SampleType type,
+                   const bool byRow, const bool mapped)
+  :file_(0),map_(0),size_(0),nrow_(nrow),ncol_(ncol),type_(type),byRow_(byRow){
+  if(nrow<=0||ncol<=0){
+    fail("the raw image has no size");
+  }
+  file_=fopen(path.c_str(),"rb");
+  if(!file_){
+    fail("can not open "+path);
+  }
+  try{
+#ifdef _WIN32
+    _fseeki64(file_,0,SEEK_END);
+    size_=(uint64_t)_ftelli64(file_);
+#else
+    fseeko(file_,0,SEEK_END);
+    size_=(uint64_t)ftello(file_);
+#endif
+    const uint64_t expected=(uint64_t)nrow*ncol*(type==DOUBLE?sizeof(double):sizeof(float));
+    if(size_<expected){
+      fail(path+" is too short for the raw image");
+    }
+#ifndef _WIN32
+    if(mapped){
+      void *map=mmap(0,size_,PROT_READ,MAP_PRIVATE,fileno(file_),0);
+      if(map!=MAP_FAILED){
+        map_=(const uint8_t*)map;
+      }
+    }
+#endif
+  }catch(...){
+    close();
+    throw;
+  }
+}
+
+RawImage::~RawImage(){
+  close();
+}
+
+void RawImage::close(){
+#ifndef _WIN32
+  if(map_){
+    munmap((void*)map_,size_);
+    map_=0;
+  }
+#endif
+  if(file_){
+    fclose(file_);
+    file_=0;
+  }
+}
+
+/**
+ * Reads count consecutive values of the file, starting with the value number first, into out, stride apart.
+ */
+void RawImage::readRun(const uint64_t first, const size_t count, double *out, const size_t stride){
+  const size_t valueBytes=type_==DOUBLE?sizeof(double):sizeof(float);
+  const uint64_t offset=first*valueBytes;
+  const size_t bytes=count*valueBytes;
+  const uint8_t *data;
+  if(map_){
+    data=map_+offset;
+  }else{
+    scratch_.resize(bytes);
+#ifdef _WIN32
+    const bool positioned=_fseeki64(file_,(long long)offset,SEEK_SET)==0;
+#else
+    const bool positioned=fseeko(file_,(off_t)offset,SEEK_SET)==0;
+#endif
+    if(!positioned||fread(&scratch_[0],1,bytes,file_)!=bytes){
+      fail("can not read the raw image");
+    }
+    data=&scratch_[0];
+  }
+  if(type_==DOUBLE){
+    for(size_t i=0;i<count;i++){
+      double value;
+      memcpy(&value,data+i*sizeof(double),sizeof(double));
+      out[i*stride]=value;
+    }
+  }else{
+    for(size_t i=0;i<count;i++){
+      float value;
+      memcpy(&value,data+i*sizeof(float),sizeof(float));
+      out[i*stride]=value;
+    }
+  }
+}
+
+void RawImage::readRows(const int firstRow, const int rows, double *out){
+  if(firstRow<0||rows<0||firstRow+rows>nrow_){
+    fail("rows out of the raw image");
+  }
+  if(byRow_){
+    for(int r=0;r<rows;r++){
+      readRun((uint64_t)(firstRow+r)*ncol_,ncol_,out+r,rows);
+    }
+  }else{
+    for(int c=0;c<ncol_;c++){
+      readRun((uint64_t)c*nrow_+firstRow,rows,out+(size_t)c*rows,1);
+    }
+  }
+}
@@ -0,0 +1,66 @@
+/**
+ * @file
+ * Reads intensities from a raw (headerless) file of 64 bit or 32 bit floating point values in the byte order of
+ * the machine, as writeBin() writes them, plain C++. The file is read in bands of rows, straight from a memory
+ * mapping where the platform allows it, so images larger than the memory can be processed piece by piece.
+ */
+#ifndef RAW_IMAGE_H
+#define RAW_IMAGE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+/**
+ * An open raw image file. All the errors (unreadable or too short files) are reported by throwing
+ * std::runtime_error.
+ */
+class RawImage {
+public:
+  enum SampleType { DOUBLE, FLOAT };
+
+  /**
+   * Opens the file and checks that it holds the whole image.
+   * @param path path to the file.
+   * @param nrow number of rows in the image.
+   * @param ncol number of columns in the image.
+   * @param type the type of the values.
+   * @param byRow whether the values are stored row after row (as most imaging software writes them) rather than
+   * column after column (as writeBin() writes a matrix).
+   * @param mapped whether to memory-map the file (where the platform allows it).
+   */
+  RawImage(const std::string &path, const int nrow, const int ncol, const SampleType type, const bool byRow,
+           const bool mapped);
+  ~RawImage();
+
+  int nrow() const { return nrow_; }
+  int ncol() const { return ncol_; }
+
+  /**
+   * Reads a band of rows.
+   * @param firstRow the first (0-based) row of the band.
+   * @param rows the number of rows in the band.
+   * @param out receives the values as a column-major rows*ncol() matrix.
+   */
+  void readRows(const int firstRow, const int rows, double *out);
+
+private:
+  RawImage(const RawImage&);
+  RawImage& operator=(const RawImage&);
+
+  void readRun(const uint64_t first, const size_t count, double *out, const size_t stride);
+  void close();
+
+  FILE *file_;
+  const uint8_t *map_;
+  uint64_t size_;
+  int nrow_;
+  int ncol_;
+  SampleType type_;
+  bool byRow_;
+  std::vector<uint8_t> scratch_;
+};
+
+#endif
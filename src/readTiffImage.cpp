@@ -0,0 +1,24 @@
+#include <Rcpp.h>
+#include "tiffImage.h"
+using namespace Rcpp;
+
+/**
+ * Rcpp export function, reads a TIFF image into an intensity matrix: the color channels of every pixel/dot
+ * (each scaled to [0,1]) are summed up while the strips/tiles are decoded, right into the returned matrix.
+ * @param imageFile path to the image file.
+ * @param normalizeValues whether to rescale the intensities to [0,1] by dividing them by their maximum.
+ * @param memoryMap whether to memory-map the file.
+ * @return a height x width numeric matrix of intensities.
+ */
+// [[Rcpp::export]]
+RcppExport SEXP readTiffImage(SEXP imageFile, SEXP normalizeValues, SEXP memoryMap) {
+BEGIN_RCPP
+  TiffImage tiff(as<std::string>(imageFile), as<bool>(memoryMap));
+  NumericMatrix img(tiff.height(), tiff.width());
+  tiff.sumChannels(img.begin());
+  if(as<bool>(normalizeValues)){
+    normalizeIntensities(img.begin(), img.size());
+  }
+  return img;
+END_RCPP
+}
@@ -0,0 +1,36 @@
+#include <Rcpp.h>
+#include "tiffImage.h"
+using namespace Rcpp;
+
+/**
+ * Rcpp export function, reads all the pages of a multi-page TIFF file (such as a confocal z-stack) into a single
+ * intensity array, page after page, the color channels of every pixel/dot summed up as readTiffImage does.
+ * @param imageFile path to the image file.
+ * @param normalizeValues whether to rescale the intensities to [0,1] by dividing them by the maximum of the
+ * whole stack.
+ * @param memoryMap whether to memory-map the file.
+ * @return a height x width x pages numeric array of intensities.
+ */
+// [[Rcpp::export]]
+RcppExport SEXP readTiffStack(SEXP imageFile, SEXP normalizeValues, SEXP memoryMap) {
+BEGIN_RCPP
+  TiffImage tiff(as<std::string>(imageFile), as<bool>(memoryMap));
+  const int height=tiff.height();
+  const int width=tiff.width();
+  const int pages=tiff.pages();
+  const size_t plane=(size_t)height*width;
+  NumericVector stack(plane*pages);
+  for(int page=0;page<pages;page++){
+    tiff.selectPage(page);
+    if(tiff.height()!=height||tiff.width()!=width){
+      stop("the pages of the TIFF file differ in size");
+    }
+    tiff.sumChannels(stack.begin()+plane*page);
+  }
+  if(as<bool>(normalizeValues)){
+    normalizeIntensities(stack.begin(), stack.size());
+  }
+  stack.attr("dim")=IntegerVector::create(height, width, pages);
+  return stack;
+END_RCPP
+}
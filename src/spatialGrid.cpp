@@ -0,0 +1,180 @@
+#include <math.h>
+#include <algorithm>
+
+#include "spatialGrid.h"
+
+/**
+ * Upper bound on the number of buckets per point, keeps the grid small for very sparse point sets.
+ */
+static const int MAX_BUCKETS_PER_POINT=4;
+
+SpatialGrid::SpatialGrid(const double *x, const double *y, const int count, const double bucketSize)
+  :minX_(0),minY_(0),bucketSize_(1),bucketsX_(1),bucketsY_(1){
+  double maxX=0;
+  double maxY=0;
+  for(int i=0;i<count;i++){
+    if(i==0||x[i]<minX_) minX_=x[i];
+    if(i==0||x[i]>maxX) maxX=x[i];
+    if(i==0||y[i]<minY_) minY_=y[i];
+    if(i==0||y[i]>maxY) maxY=y[i];
+  }
+  const double width=maxX-minX_;
+  const double height=maxY-minY_;
+  if(bucketSize>0){
+    bucketSize_=bucketSize;
+  }else if(count>0&&width*height>0){
+    bucketSize_=sqrt(2*width*height/count);
+  }else if(count>0&&width+height>0){
+    bucketSize_=2*(width+height)/count;
+  }
+  //a bucket size giving too many buckets is widened, and so is one making the bucket counts overflow
+  const double limit=(double)MAX_BUCKETS_PER_POINT*std::max(count,1);
+  while((floor(width/bucketSize_)+1)*(floor(height/bucketSize_)+1)>limit){
+    bucketSize_*=2;
+  }
+  bucketsX_=(int)floor(width/bucketSize_)+1;
+  bucketsY_=(int)floor(height/bucketSize_)+1;
+
+  //counting sort of the points by bucket
+  std::vector<int> buckets(count);
+  starts_.assign((size_t)bucketsX_*bucketsY_+1,0);
+  for(int i=0;i<count;i++){
+    buckets[i]=bucketX(x[i])+bucketY(y[i])*bucketsX_;
+    starts_[buckets[i]+1]++;
+  }
+  for(size_t b=1;b<starts_.size();b++){
+    starts_[b]+=starts_[b-1];
+  }
+  std::vector<int> fill(starts_.begin(),starts_.end()-1);
+  x_.resize(count);
+  y_.resize(count);
+  ids_.resize(count);
+  slots_.resize(count);
+  for(int i=0;i<count;i++){
+    const int slot=fill[buckets[i]]++;
+    x_[slot]=x[i];
+    y_[slot]=y[i];
+    ids_[slot]=i;
+    slots_[i]=slot;
+  }
+}
+
+int SpatialGrid::bucketX(const double x) const {
+  //NaN falls in the first bucket rather than being cast to int
+  const double b=floor((x-minX_)/bucketSize_);
+  return !(b>0)?0:(b>=bucketsX_?bucketsX_-1:(int)b);
+}
+
+int SpatialGrid::bucketY(const double y) const {
+  const double b=floor((y-minY_)/bucketSize_);
+  return !(b>0)?0:(b>=bucketsY_?bucketsY_-1:(int)b);
+}
+
+/**
+ * Calls visit(slot) for every point in a block of buckets (bounds inclusive, clipped to the grid).
+ */
+template<class Visit>
+void SpatialGrid::visitBuckets(const int bx0, const int bx1, const int by0, const int by1, Visit &visit) const {
+  for(int by=std::max(0,by0);by<=std::min(bucketsY_-1,by1);by++){
+    for(int bx=std::max(0,bx0);bx<=std::min(bucketsX_-1,bx1);bx++){
+      const int b=bx+by*bucketsX_;
+      for(int slot=starts_[b];slot<starts_[b+1];slot++){
+        visit(slot);
+      }
+    }
+  }
+}
+
+void SpatialGrid::radius(const double qx, const double qy, const double radius, std::vector<int> &out) const {
+  out.clear();
+  const double r2=radius*radius;
+  auto visit=[&](const int slot){
+    const double dx=x_[slot]-qx;
+    const double dy=y_[slot]-qy;
+    if(dx*dx+dy*dy<=r2){
+      out.push_back(ids_[slot]);
+    }
+  };
+  visitBuckets(bucketX(qx-radius),bucketX(qx+radius),bucketY(qy-radius),bucketY(qy+radius),visit);
+  std::sort(out.begin(),out.end());
+}
+
+int SpatialGrid::radiusCount(const double qx, const double qy, const double radius) const {
+  int count=0;
+  const double r2=radius*radius;
+  auto visit=[&](const int slot){
+    const double dx=x_[slot]-qx;
+    const double dy=y_[slot]-qy;
+    if(dx*dx+dy*dy<=r2){
+      count++;
+    }
+  };
+  visitBuckets(bucketX(qx-radius),bucketX(qx+radius),bucketY(qy-radius),bucketY(qy+radius),visit);
+  return count;
+}
+
+/**
+ * A candidate neighbor: squared distance and index, ordered by both.
+ */
+typedef std::pair<double,int> Candidate;
+
+/**
+ * The search grows a square block of buckets around the bucket of the location one ring at a time, until the
+ * k-th nearest candidate found is closer than anything outside the block can be.
+ */
+void SpatialGrid::nearest(const double qx, const double qy, const int k, const int exclude, int *index,
+                          double *distance) const {
+  const int cx=bucketX(qx);
+  const int cy=bucketY(qy);
+  std::vector<Candidate> candidates;
+  auto visit=[&](const int slot){
+    if(ids_[slot]!=exclude){
+      const double dx=x_[slot]-qx;
+      const double dy=y_[slot]-qy;
+      candidates.push_back(Candidate(dx*dx+dy*dy,ids_[slot]));
+    }
+  };
+  const int rings=std::max(std::max(cx,bucketsX_-1-cx),std::max(cy,bucketsY_-1-cy));
+  for(int r=0;r<=rings;r++){
+    if(r==0){
+      visitBuckets(cx,cx,cy,cy,visit);
+    }else{
+      visitBuckets(cx-r,cx+r,cy-r,cy-r,visit);
+      visitBuckets(cx-r,cx+r,cy+r,cy+r,visit);
+      visitBuckets(cx-r,cx-r,cy-r+1,cy+r-1,visit);
+      visitBuckets(cx+r,cx+r,cy-r+1,cy+r-1,visit);
+    }
+    if((int)candidates.size()>=k){
+      std::nth_element(candidates.begin(),candidates.begin()+(k-1),candidates.end());
+      //the distance from the location to the border of the block, nothing outside can be any closer
+      const double reach=std::min(std::min(qx-(minX_+(cx-r)*bucketSize_),minX_+(cx+r+1)*bucketSize_-qx),
+                                  std::min(qy-(minY_+(cy-r)*bucketSize_),minY_+(cy+r+1)*bucketSize_-qy));
+      if(reach>0&&candidates[k-1].first<reach*reach){
+        break;
+      }
+    }
+  }
+  //fewer than k candidates only if k is out of range, the rest is reported as not found
+  const int found=std::min(k,(int)candidates.size());
+  std::partial_sort(candidates.begin(),candidates.begin()+found,candidates.end());
+  for(int n=0;n<found;n++){
+    index[n]=candidates[n].second;
+    distance[n]=sqrt(candidates[n].first);
+  }
+  for(int n=found;n<k;n++){
+    index[n]=-1;
+    distance[n]=INFINITY;
+  }
+}
+
+void SpatialGrid::window(const double x0, const double x1, const double y0, const double y1,
+                         std::vector<int> &out) const {
+  out.clear();
+  auto visit=[&](const int slot){
+    if(x_[slot]>=x0&&x_[slot]<=x1&&y_[slot]>=y0&&y_[slot]<=y1){
+      out.push_back(ids_[slot]);
+    }
+  };
+  visitBuckets(bucketX(x0),bucketX(x1),bucketY(y0),bucketY(y1),visit);
+  std::sort(out.begin(),out.end());
+}
@@ -0,0 +1,87 @@
+/**
+ * @file
+ * A spatial index over 2D points (the centres of detected cells), plain C++. The points are hashed into a
+ * uniform grid of square buckets and stored bucket after bucket (compressed sparse row layout), so a query only
+ * looks at the buckets that may hold an answer and reads their points from contiguous memory.
+ */
+#ifndef SPATIAL_GRID_H
+#define SPATIAL_GRID_H
+
+#include <vector>
+
+class SpatialGrid {
+public:
+  /**
+   * Builds the index.
+   * @param x the x coordinates of the points.
+   * @param y the y coordinates of the points.
+   * @param count number of points.
+   * @param bucketSize side of a bucket, values not above 0 pick one holding two points on average.
+   */
+  SpatialGrid(const double *x, const double *y, const int count, const double bucketSize);
+
+  int size() const { return (int)ids_.size(); }
+  double bucketSize() const { return bucketSize_; }
+  /**
+   * @return the x coordinate of the point with the given (0-based) index.
+   */
+  double x(const int id) const { return x_[slots_[id]]; }
+  /**
+   * @return the y coordinate of the point with the given (0-based) index.
+   */
+  double y(const int id) const { return y_[slots_[id]]; }
+
+  /**
+   * Finds the points within a distance of a location.
+   * @param qx x coordinate of the location.
+   * @param qy y coordinate of the location.
+   * @param radius the distance, points exactly that far are included.
+   * @param out receives the 0-based indices of the points, ascending.
+   */
+  void radius(const double qx, const double qy, const double radius, std::vector<int> &out) const;
+  /**
+   * Counts the points within a distance of a location, see radius().
+   */
+  int radiusCount(const double qx, const double qy, const double radius) const;
+  /**
+   * Finds the k nearest points to a location.
+   * @param qx x coordinate of the location.
+   * @param qy y coordinate of the location.
+   * @param k number of points to find, at most size() (less one if exclude is a valid index).
+   * @param exclude index of a point not to report (the query point itself), -1 for none.
+   * @param index receives the 0-based indices of the points, nearest first (ties broken by the index), -1 past
+   * the last point if there are fewer than k to report.
+   * @param distance receives the distances to the points, infinite past the last one.
+   */
+  void nearest(const double qx, const double qy, const int k, const int exclude, int *index, double *distance) const;
+  /**
+   * Finds the points in a rectangular window, borders included.
+   * @param out receives the 0-based indices of the points, ascending.
+   */
+  void window(const double x0, const double x1, const double y0, const double y1, std::vector<int> &out) const;
+
+private:
+  int bucketX(const double x) const;
+  int bucketY(const double y) const;
+  template<class Visit>
+  void visitBuckets(const int bx0, const int bx1, const int by0, const int by1, Visit &visit) const;
+
+  double minX_;
+  double minY_;
+  double bucketSize_;
+  int bucketsX_;
+  int bucketsY_;
+  /**
+   * points of bucket b occupy [starts_[b],starts_[b+1]) of x_, y_ and ids_, buckets are column-major.
+   */
+  std::vector<int> starts_;
+  std::vector<double> x_;
+  std::vector<double> y_;
+  std::vector<int> ids_;
+  /**
+   * position of every point in the bucket order.
+   */
+  std::vector<int> slots_;
+};
+
+#endif
@@ -0,0 +1,111 @@
+#include <limits.h>
+#include <string.h>
+#include <memory>
+#include <stdexcept>
+
+#include "streamSearch.h"
+
+/**
+ * @return the largest intensity of the image, read band by band.
+ */
+static double maximumIntensity(RowSource &source, const int bandRows, std::vector<double> &buffer){
+  double max=0;
+  for(int first=0;first<source.nrow();first+=bandRows){
+    const int rows=std::min(bandRows,source.nrow()-first);
+    buffer.resize((size_t)rows*source.ncol());
+    source.readRows(first,rows,&buffer[0]);
+    for(size_t i=0;i<buffer.size();i++){
+      if(buffer[i]>max) max=buffer[i];
+    }
+  }
+  return max;
+}
+
+/**
+ * Tells the seeds (0-based column-major window indices) that lie outside the band.
+ */
+struct OutsideBand {
+  int rows;
+  int top;
+  int bottom;
+  OutsideBand(const int rows, const int top, const int bottom):rows(rows),top(top),bottom(bottom){}
+  bool operator()(const int seed) const { const int row=seed%rows; return row<top||row>=bottom; }
+};
+
+void streamClusters(RowSource &source, const ClusterParams &params, const int bandRows, const bool normalize,
+                    const int threads, ClusterSet &clusters, ClusterSink &sink){
+  const int nrow=source.nrow();
+  const int ncol=source.ncol();
+  const int halo=std::max(1,(int)ceil(params.halo()));
+  const int band=std::max(1,bandRows);
+  if((double)(band+2*halo+2)*(ncol+2)>INT_MAX){
+    throw std::runtime_error("the bands are too large for the image width, use fewer rows per band");
+  }
+
+  std::vector<double> fresh;
+  double max=0;
+  if(normalize){
+    max=maximumIntensity(source,band,fresh);
+  }
+
+  std::vector<double> window;
+  std::vector<double> previous;
+  std::unique_ptr<PixelField> field;
+  std::unique_ptr<PixelField> previousField;
+  std::vector<int> seeds;
+  int previousFirst=0;
+  int previousLast=0;
+
+  for(int start=0;start<nrow;start+=band){
+    const int end=std::min(nrow,start+band);
+    const int first=std::max(0,start-halo);
+    const int last=std::min(nrow,end+halo);
+    const int rows=last-first;
+    const int carried=std::max(0,previousLast-first);
+
+    //the rows shared with the previous window are carried over, the others are read in
+    fresh.resize((size_t)(rows-carried)*ncol);
+    if(rows>carried){
+      source.readRows(first+carried,rows-carried,&fresh[0]);
+      if(max>0){
+        for(size_t i=0;i<fresh.size();i++){
+          fresh[i]/=max;
+        }
+      }
+    }
+    window.resize((size_t)rows*ncol);
+    for(int c=0;c<ncol;c++){
+      double *column=&window[0]+(size_t)c*rows;
+      if(carried>0){
+        memcpy(column,&previous[0]+(size_t)c*(previousLast-previousFirst)+(first-previousFirst),
+               carried*sizeof(double));
+      }
+      if(rows>carried){
+        memcpy(column+carried,&fresh[0]+(size_t)c*(rows-carried),(rows-carried)*sizeof(double));
+      }
+    }
+
+    field.reset(new PixelField(&window[0],rows,ncol,params.cutoff));
+    for(int y=1;y<=ncol;y++){
+      for(int r=0;r<carried;r++){
+        if(previousField->visited(previousField->index(first-previousFirst+r+1,y))){
+          field->setVisited(field->index(r+1,y));
+        }
+      }
+    }
+
+    sortSeeds(&window[0],rows*ncol,params.cutoff,seeds);
+    seeds.erase(std::remove_if(seeds.begin(),seeds.end(),OutsideBand(rows,start-first,end-first)),seeds.end());
+    clusters.clear();
+    findClusters(*field,seeds,params,threads,clusters);
+    for(size_t i=0;i<clusters.summaries.size();i++){
+      clusters.summaries[i].x+=first;
+    }
+    sink.emit(clusters,*field,first);
+
+    window.swap(previous);
+    field.swap(previousField);
+    previousFirst=first;
+    previousLast=last;
+  }
+}
@@ -0,0 +1,101 @@
+/**
+ * @file
+ * Cluster search over images read in bands of rows, plain C++, for images too large to be held in memory (such
+ * as stitched mosaics). Only a window of rows is kept: the band being searched plus a halo (see
+ * ClusterParams::halo()) of rows above and below it, which is all the clusters of its seeds can read or take.
+ * The rows below the band come in with the window, the ones above it are carried over from the previous window
+ * along with the pixels/dots already taken by its clusters.
+ *
+ * The seeds of a band are taken brightest first, as in findClusters(), but the bands are searched one after the
+ * other, so a seed of a band grows before any (even brighter) seed of the bands below. The clusters come out as
+ * those of getClusters for the whole image except where clusters of two bands compete for pixels/dots across the
+ * band boundary. A cluster never changes after it has grown, so the clusters of a band are handed out as soon as
+ * the band is searched.
+ */
+#ifndef STREAM_SEARCH_H
+#define STREAM_SEARCH_H
+
+#include <string>
+#include <vector>
+
+#include "clusterSearch.h"
+#include "rawImage.h"
+#include "tiffImage.h"
+
+/**
+ * A source of image intensities that can be read in bands of rows.
+ */
+class RowSource {
+public:
+  virtual ~RowSource(){}
+  virtual int nrow() const=0;
+  virtual int ncol() const=0;
+  /**
+   * Reads a band of rows.
+   * @param firstRow the first (0-based) row of the band.
+   * @param rows the number of rows in the band.
+   * @param out receives the intensities as a column-major rows*ncol() matrix.
+   */
+  virtual void readRows(const int firstRow, const int rows, double *out)=0;
+};
+
+/**
+ * Rows of a TIFF image, the channels of each pixel/dot summed (see TiffImage::sumChannels()).
+ */
+class TiffRowSource : public RowSource {
+public:
+  TiffRowSource(const std::string &path, const bool mapped):image_(path,mapped){}
+  int nrow() const { return image_.height(); }
+  int ncol() const { return image_.width(); }
+  void readRows(const int firstRow, const int rows, double *out) { image_.sumChannels(firstRow,rows,out); }
+private:
+  TiffImage image_;
+};
+
+/**
+ * Rows of a raw image file (see RawImage).
+ */
+class RawRowSource : public RowSource {
+public:
+  RawRowSource(const std::string &path, const int nrow, const int ncol, const RawImage::SampleType type,
+               const bool byRow, const bool mapped):image_(path,nrow,ncol,type,byRow,mapped){}
+  int nrow() const { return image_.nrow(); }
+  int ncol() const { return image_.ncol(); }
+  void readRows(const int firstRow, const int rows, double *out) { image_.readRows(firstRow,rows,out); }
+private:
+  RawImage image_;
+};
+
+/**
+ * Receives the clusters of every band as soon as it is searched.
+ */
+class ClusterSink {
+public:
+  virtual ~ClusterSink(){}
+  /**
+   * @param clusters the clusters of the band, in the order of their seeds. The pixels/dots are field indices
+   * into the window the band was searched in, the summaries are in the coordinates of the whole image.
+   * @param field the field of the window.
+   * @param firstRow the (0-based) row of the image the window starts with, image row firstRow+field.x(index)
+   * (1-based) holds the pixel/dot of a field index.
+   */
+  virtual void emit(const ClusterSet &clusters, const PixelField &field, const int firstRow)=0;
+};
+
+/**
+ * Searches an image band by band.
+ * @param source the image.
+ * @param params search parameters.
+ * @param bandRows the number of rows in a band, the window holds that many plus two halos.
+ * @param normalize whether to rescale the intensities to [0,1] first (see normalizeIntensities()), which takes
+ * an extra pass over the image to find their maximum.
+ * @param threads the number of threads to search each band with, values below 1 mean as many as there are
+ * hardware threads.
+ * @param clusters the clusters handed to the sink, set up (keepPixels, summarize) by the caller and refilled for
+ * every band.
+ * @param sink receives the clusters of the bands, top to bottom.
+ */
+void streamClusters(RowSource &source, const ClusterParams &params, const int bandRows, const bool normalize,
+                    const int threads, ClusterSet &clusters, ClusterSink &sink);
+
+#endif
@@ -0,0 +1,611 @@
+#include <string.h>
+#include <math.h>
+#include <stdexcept>
+#include <algorithm>
+#include <set>
+#include <zlib.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#include "tiffImage.h"
+
+static const int TAG_IMAGE_WIDTH=256;
+static const int TAG_IMAGE_LENGTH=257;
+static const int TAG_BITS_PER_SAMPLE=258;
+static const int TAG_COMPRESSION=259;
+static const int TAG_PHOTOMETRIC=262;
+static const int TAG_STRIP_OFFSETS=273;
+static const int TAG_SAMPLES_PER_PIXEL=277;
+static const int TAG_ROWS_PER_STRIP=278;
+static const int TAG_STRIP_BYTE_COUNTS=279;
+static const int TAG_PLANAR_CONFIGURATION=284;
+static const int TAG_PREDICTOR=317;
+static const int TAG_TILE_WIDTH=322;
+static const int TAG_TILE_LENGTH=323;
+static const int TAG_TILE_OFFSETS=324;
+static const int TAG_TILE_BYTE_COUNTS=325;
+static const int TAG_SAMPLE_FORMAT=339;
+
+static const int COMPRESSION_NONE=1;
+static const int COMPRESSION_LZW=5;
+static const int COMPRESSION_DEFLATE=8;
+static const int COMPRESSION_ADOBE_DEFLATE=32946;
+static const int COMPRESSION_PACKBITS=32773;
+
+static const int SAMPLE_FORMAT_UINT=1;
+static const int SAMPLE_FORMAT_FLOAT=3;
+
+static void fail(const std::string &message){
+  throw std::runtime_error(message);
+}
+
+static bool hostBigEndian(){
+  const uint16_t one=1;
+  uint8_t first;
+  memcpy(&first,&one,1);
+  return first==0;
+}
+
+/**
+ * Decodes TIFF flavoured LZW (MSB-first codes of 9 to 12 bits, code width switching one code early). Every
+ * string in the code table is a run of bytes that has already been written to the output, so the table only
+ * keeps its position and length there.
+ * @return the number of bytes written.
+ */
+static size_t decodeLzw(const uint8_t *in, const size_t inSize, uint8_t *out, const size_t outSize){
+  static const int CLEAR=256;
+  static const int END_OF_INFORMATION=257;
+  std::vector<size_t> start(4096);
+  std::vector<size_t> length(4096);
+  size_t inPos=0;
+  size_t pos=0;
+  uint32_t bits=0;
+  int bitCount=0;
+  int width=9;
+  int next=258;
+  bool first=true;
+  size_t previousStart=0;
+  size_t previousLength=0;
+
+  while(pos<outSize){
+    while(bitCount<width){
+      if(inPos>=inSize){
+        return pos;
+      }
+      bits=(bits<<8)|in[inPos++];
+      bitCount+=8;
+    }
+    const int code=(int)((bits>>(bitCount-width))&((1u<<width)-1));
+    bitCount-=width;
+
+    if(code==END_OF_INFORMATION){
+      break;
+    }
+    if(code==CLEAR){
+      width=9;
+      next=258;
+      first=true;
+      continue;
+    }
+
+    size_t currentLength;
+    if(code<256){
+      out[pos]=(uint8_t)code;
+      currentLength=1;
+    }else if(first){
+      fail("corrupt LZW data");
+    }else if(code<next){
+      currentLength=std::min(length[code],outSize-pos);
+      memcpy(out+pos,out+start[code],currentLength);
+    }else if(code==next){
+      //the string being defined right now: the previous one followed by its own first byte
+      currentLength=std::min(previousLength+1,outSize-pos);
+      memcpy(out+pos,out+previousStart,std::min(previousLength,currentLength));
+      if(currentLength>previousLength){
+        out[pos+previousLength]=out[previousStart];
+      }
+    }else{
+      fail("corrupt LZW data");
+    }
+
+    if(!first&&next<4096){
+      start[next]=previousStart;
+      length[next]=previousLength+1;
+      next++;
+      if(next+1>=(1<<width)&&width<12){
+        width++;
+      }
+    }
+    first=false;
+    previousStart=pos;
+    previousLength=currentLength;
+    pos+=currentLength;
+  }
+  return pos;
+}
+
+/**
+ * Decodes zlib wrapped Deflate data.
+ * @return the number of bytes written.
+ */
+static size_t decodeDeflate(const uint8_t *in, const size_t inSize, uint8_t *out, const size_t outSize){
+  z_stream stream;
+  memset(&stream,0,sizeof(stream));
+  if(inflateInit(&stream)!=Z_OK){
+    fail("can not initialize zlib");
+  }
+  stream.next_in=(Bytef*)in;
+  stream.avail_in=(uInt)inSize;
+  stream.next_out=(Bytef*)out;
+  stream.avail_out=(uInt)outSize;
+  const int status=inflate(&stream,Z_FINISH);
+  const size_t written=outSize-stream.avail_out;
+  inflateEnd(&stream);
+  if(status!=Z_STREAM_END&&status!=Z_BUF_ERROR&&status!=Z_OK){
+    fail("corrupt Deflate data");
+  }
+  return written;
+}
+
+/**
+ * Decodes PackBits run-length encoded data.
+ * @return the number of bytes written.
+ */
+static size_t decodePackBits(const uint8_t *in, const size_t inSize, uint8_t *out, const size_t outSize){
+  size_t inPos=0;
+  size_t pos=0;
+  while(inPos<inSize&&pos<outSize){
+    const int n=(int8_t)in[inPos++];
+    if(n>=0){
+      const size_t count=std::min(std::min((size_t)n+1,inSize-inPos),outSize-pos);
+      memcpy(out+pos,in+inPos,count);
+      inPos+=n+1;
+      pos+=count;
+    }else if(n!=-128&&inPos<inSize){
+      const size_t count=std::min((size_t)(1-n),outSize-pos);
+      memset(out+pos,in[inPos++],count);
+      pos+=count;
+    }
+  }
+  return pos;
+}
+
+/**
+ * Reverses the byte order of every sample.
+ */
+static void swapBytes(uint8_t *data, const size_t size, const int sampleBytes){
+  for(size_t i=0;i+sampleBytes<=size;i+=sampleBytes){
+    std::reverse(data+i,data+i+sampleBytes);
+  }
+}
+
+/**
+ * Undoes horizontal differencing (predictor 2) on host ordered integer samples.
+ */
+template<class T>
+static void undoDifferencing(uint8_t *data, const int rows, const size_t rowBytes, const size_t rowSamples,
+                             const int samplesPerPixel){
+  for(int r=0;r<rows;r++){
+    T *row=(T*)(data+r*rowBytes);
+    for(size_t i=samplesPerPixel;i<rowSamples;i++){
+      row[i]=(T)(row[i]+row[i-samplesPerPixel]);
+    }
+  }
+}
+
+/**
+ * Adds the sum of the first channels of every pixel/dot in a decoded row to a strided target.
+ */
+template<class T>
+static void addRow(const uint8_t *row, const int cols, const int samplesPerPixel, const int channels,
+                   const double scale, double *target, const size_t stride){
+  for(int c=0;c<cols;c++){
+    const uint8_t *pixel=row+(size_t)c*samplesPerPixel*sizeof(T);
+    double sum=0;
+    for(int k=0;k<channels;k++){
+      T sample;
+      memcpy(&sample,pixel+k*sizeof(T),sizeof(T));
+      sum+=sample;
+    }
+    target[c*stride]+=sum*scale;
+  }
+}
+
+TiffImage::TiffImage(const std::string &path, const bool mapped)
+  :file_(0),map_(0),size_(0),bigEndian_(false),bigTiff_(false),width_(0),height_(0),channels_(0),samplesPerPixel_(0),
+   bitsPerSample_(0),sampleFormat_(0),compression_(0),predictor_(0),planar_(false),tiled_(false),chunkWidth_(0),
+   chunkHeight_(0),cachedChunk_(-1),cachedData_(0){
+  file_=fopen(path.c_str(),"rb");
+  if(!file_){
+    fail("can not open "+path);
+  }
+  try{
+#ifdef _WIN32
+    _fseeki64(file_,0,SEEK_END);
+    size_=(uint64_t)_ftelli64(file_);
+#else
+    fseeko(file_,0,SEEK_END);
+    size_=(uint64_t)ftello(file_);
+    if(mapped&&size_>0){
+      void *map=mmap(0,size_,PROT_READ,MAP_PRIVATE,fileno(file_),0);
+      if(map!=MAP_FAILED){
+        map_=(const uint8_t*)map;
+      }
+    }
+#endif
+    std::vector<uint8_t> scratch;
+    const uint8_t *header=bytes(0,8,scratch);
+    if(header[0]=='I'&&header[1]=='I'){
+      bigEndian_=false;
+    }else if(header[0]=='M'&&header[1]=='M'){
+      bigEndian_=true;
+    }else{
+      fail(path+" is not a TIFF file");
+    }
+    const uint16_t magic=read16(header+2);
+    if(magic==43){
+      bigTiff_=true;
+      header=bytes(0,16,scratch);
+      if(read16(header+4)!=8){
+        fail(path+" is not a TIFF file");
+      }
+      findPages(read64(header+8));
+    }else if(magic==42){
+      findPages(read32(header+4));
+    }else{
+      fail(path+" is not a TIFF file");
+    }
+    readDirectory(pageOffsets_[0]);
+  }catch(...){
+    close();
+    throw;
+  }
+}
+
+TiffImage::~TiffImage(){
+  close();
+}
+
+void TiffImage::close(){
+#ifndef _WIN32
+  if(map_){
+    munmap((void*)map_,size_);
+    map_=0;
+  }
+#endif
+  if(file_){
+    fclose(file_);
+    file_=0;
+  }
+}
+
+/**
+ * @return a pointer to count bytes of the file starting at offset, either right into the mapping or into scratch.
+ */
+const uint8_t *TiffImage::bytes(const uint64_t offset, const size_t count, std::vector<uint8_t> &scratch) const {
+  if(offset>size_||count>size_-offset){
+    fail("truncated TIFF file");
+  }
+  if(map_){
+    return map_+offset;
+  }
+  scratch.resize(std::max(count,(size_t)1));
+#ifdef _WIN32
+  const bool positioned=_fseeki64(file_,(long long)offset,SEEK_SET)==0;
+#else
+  const bool positioned=fseeko(file_,(off_t)offset,SEEK_SET)==0;
+#endif
+  if(!positioned||fread(&scratch[0],1,count,file_)!=count){
+    fail("can not read the TIFF file");
+  }
+  return &scratch[0];
+}
+
+uint16_t TiffImage::read16(const uint8_t *p) const {
+  return bigEndian_?(uint16_t)((p[0]<<8)|p[1]):(uint16_t)((p[1]<<8)|p[0]);
+}
+
+uint32_t TiffImage::read32(const uint8_t *p) const {
+  return bigEndian_?((uint32_t)p[0]<<24)|((uint32_t)p[1]<<16)|((uint32_t)p[2]<<8)|p[3]
+                   :((uint32_t)p[3]<<24)|((uint32_t)p[2]<<16)|((uint32_t)p[1]<<8)|p[0];
+}
+
+uint64_t TiffImage::read64(const uint8_t *p) const {
+  const uint64_t first=read32(p);
+  const uint64_t second=read32(p+4);
+  return bigEndian_?(first<<32)|second:(second<<32)|first;
+}
+
+/**
+ * Follows the chain of image file directories from the first one at offset, collecting their offsets. Only the
+ * entry count and the link to the next directory of each are read. A link that leads out of the file ends the
+ * chain, as some writers leave it dangling after the last page.
+ */
+void TiffImage::findPages(uint64_t offset){
+  const int countBytes=bigTiff_?8:2;
+  const int entrySize=bigTiff_?20:12;
+  const int linkBytes=bigTiff_?8:4;
+  std::set<uint64_t> seen;
+  std::vector<uint8_t> scratch;
+  do{
+    if(!seen.insert(offset).second){
+      fail("the TIFF pages form a loop");
+    }
+    pageOffsets_.push_back(offset);
+    const uint8_t *countData=bytes(offset,countBytes,scratch);
+    const uint64_t entries=bigTiff_?read64(countData):read16(countData);
+    if(entries>size_/entrySize){
+      fail("truncated TIFF file");
+    }
+    const uint64_t link=offset+countBytes+entries*entrySize;
+    if(link>size_||size_-link<(uint64_t)linkBytes){
+      break;
+    }
+    const uint8_t *next=bytes(link,linkBytes,scratch);
+    offset=bigTiff_?read64(next):read32(next);
+  }while(offset!=0&&offset<size_&&size_-offset>=(uint64_t)countBytes);
+}
+
+void TiffImage::selectPage(const int page){
+  if(page<0||page>=pages()){
+    fail("page out of the TIFF file");
+  }
+  readDirectory(pageOffsets_[page]);
+}
+
+/**
+ * Reads the image file directory at offset and checks that the image is one this reader can handle.
+ */
+void TiffImage::readDirectory(const uint64_t offset){
+  //BigTIFF directories have 8 byte entry counts, 20 byte entries with 8 byte value counts and offsets
+  const int countBytes=bigTiff_?8:2;
+  const int entrySize=bigTiff_?20:12;
+  const int inlineBytes=bigTiff_?8:4;
+  std::vector<uint8_t> scratch;
+  const uint8_t *countData=bytes(offset,countBytes,scratch);
+  const uint64_t entries=bigTiff_?read64(countData):read16(countData);
+  if(entries>size_/entrySize){
+    fail("truncated TIFF file");
+  }
+  std::vector<uint8_t> entryBytes;
+  const uint8_t *entry=bytes(offset+countBytes,(size_t)entries*entrySize,entryBytes);
+
+  width_=0;
+  height_=0;
+  samplesPerPixel_=1;
+  bitsPerSample_=1;
+  sampleFormat_=SAMPLE_FORMAT_UINT;
+  compression_=COMPRESSION_NONE;
+  predictor_=1;
+  planar_=false;
+  int photometric=-1;
+  uint64_t rowsPerStrip=0;
+  int tileWidth=0;
+  int tileLength=0;
+  std::vector<uint64_t> bits;
+  std::vector<uint64_t> stripOffsets;
+  std::vector<uint64_t> stripByteCounts;
+  std::vector<uint64_t> tileOffsets;
+  std::vector<uint64_t> tileByteCounts;
+
+  for(uint64_t e=0;e<entries;e++,entry+=entrySize){
+    const int tag=read16(entry);
+    const int type=read16(entry+2);
+    const uint64_t count=bigTiff_?read64(entry+4):read32(entry+4);
+    const int typeSize=type==3?2:type==4?4:type==1?1:type==16?8:0;
+    if(typeSize==0||count==0){
+      continue;
+    }
+    if(count>size_/typeSize){
+      fail("truncated TIFF file");
+    }
+    const size_t size=(size_t)typeSize*count;
+    const uint8_t *value=entry+entrySize-inlineBytes;
+    std::vector<uint8_t> valueBytes;
+    const uint8_t *data=size<=(size_t)inlineBytes?value:
+      bytes(bigTiff_?read64(value):read32(value),size,valueBytes);
+    std::vector<uint64_t> values(count);
+    for(uint64_t i=0;i<count;i++){
+      values[i]=typeSize==2?read16(data+2*i):typeSize==4?read32(data+4*i):typeSize==8?read64(data+8*i):data[i];
+    }
+
+    switch(tag){
+    case TAG_IMAGE_WIDTH: width_=(int)values[0]; break;
+    case TAG_IMAGE_LENGTH: height_=(int)values[0]; break;
+    case TAG_BITS_PER_SAMPLE: bits=values; break;
+    case TAG_COMPRESSION: compression_=(int)values[0]; break;
+    case TAG_PHOTOMETRIC: photometric=(int)values[0]; break;
+    case TAG_STRIP_OFFSETS: stripOffsets=values; break;
+    case TAG_SAMPLES_PER_PIXEL: samplesPerPixel_=(int)values[0]; break;
+    case TAG_ROWS_PER_STRIP: rowsPerStrip=values[0]; break;
+    case TAG_STRIP_BYTE_COUNTS: stripByteCounts=values; break;
+    case TAG_PLANAR_CONFIGURATION: planar_=values[0]==2; break;
+    case TAG_PREDICTOR: predictor_=(int)values[0]; break;
+    case TAG_TILE_WIDTH: tileWidth=(int)values[0]; break;
+    case TAG_TILE_LENGTH: tileLength=(int)values[0]; break;
+    case TAG_TILE_OFFSETS: tileOffsets=values; break;
+    case TAG_TILE_BYTE_COUNTS: tileByteCounts=values; break;
+    case TAG_SAMPLE_FORMAT: sampleFormat_=(int)values[0]; break;
+    default: break;
+    }
+  }
+
+  if(width_<=0||height_<=0){
+    fail("the TIFF image has no size");
+  }
+  if(samplesPerPixel_<1){
+    fail("the TIFF image has no samples");
+  }
+  if(!bits.empty()){
+    bitsPerSample_=(int)bits[0];
+    for(size_t i=1;i<bits.size();i++){
+      if((int)bits[i]!=bitsPerSample_){
+        fail("TIFF images with different sample sizes are not supported");
+      }
+    }
+  }
+  const bool integer=sampleFormat_==SAMPLE_FORMAT_UINT&&(bitsPerSample_==8||bitsPerSample_==16||bitsPerSample_==32);
+  const bool floating=sampleFormat_==SAMPLE_FORMAT_FLOAT&&(bitsPerSample_==32||bitsPerSample_==64);
+  if(!integer&&!floating){
+    fail("only 8, 16 and 32 bit unsigned or 32 and 64 bit floating point TIFF samples are supported");
+  }
+  if(photometric==0||photometric==1){
+    channels_=1;
+  }else if(photometric==2&&samplesPerPixel_>=3){
+    channels_=3;
+  }else if(photometric==-1){
+    channels_=samplesPerPixel_>=3?3:1;
+  }else{
+    fail("only grayscale and RGB TIFF images are supported");
+  }
+  if(compression_!=COMPRESSION_NONE&&compression_!=COMPRESSION_LZW&&compression_!=COMPRESSION_DEFLATE&&
+     compression_!=COMPRESSION_ADOBE_DEFLATE&&compression_!=COMPRESSION_PACKBITS){
+    fail("only uncompressed, LZW, Deflate and PackBits compressed TIFF images are supported");
+  }
+  if(predictor_!=1&&!(predictor_==2&&integer)){
+    fail("unsupported TIFF predictor");
+  }
+
+  tiled_=!tileOffsets.empty();
+  if(tiled_){
+    if(tileWidth<=0||tileLength<=0){
+      fail("the TIFF tiles have no size");
+    }
+    //tiles are multiples of 16 wide and long, larger ones than the image rounded up to that hold nothing of it
+    if(tileWidth>((int64_t)width_+15)/16*16||tileLength>((int64_t)height_+15)/16*16){
+      fail("the TIFF tiles are larger than the image");
+    }
+    chunkWidth_=tileWidth;
+    chunkHeight_=tileLength;
+    chunkOffsets_.swap(tileOffsets);
+    chunkByteCounts_.swap(tileByteCounts);
+  }else{
+    chunkWidth_=width_;
+    chunkHeight_=rowsPerStrip==0||rowsPerStrip>(uint64_t)height_?height_:(int)rowsPerStrip;
+    chunkOffsets_.swap(stripOffsets);
+    chunkByteCounts_.swap(stripByteCounts);
+  }
+  //a decoded strip or tile must be addressable, the sizes computed from the tags must not wrap around
+  const uint64_t pixelBytes=(uint64_t)(planar_?1:samplesPerPixel_)*(bitsPerSample_/8);
+  const uint64_t maxChunkBytes=SIZE_MAX/2;
+  if((uint64_t)chunkWidth_>maxChunkBytes/pixelBytes||
+     (uint64_t)chunkHeight_>maxChunkBytes/((uint64_t)chunkWidth_*pixelBytes)){
+    fail("the TIFF strips or tiles are too large");
+  }
+  const uint64_t chunksPerPlane=(uint64_t)(((int64_t)width_+chunkWidth_-1)/chunkWidth_)*
+    (uint64_t)(((int64_t)height_+chunkHeight_-1)/chunkHeight_);
+  const uint64_t planes=planar_?samplesPerPixel_:1;
+  if(chunkOffsets_.size()/planes<chunksPerPlane){
+    fail("the TIFF image is missing strips or tiles");
+  }
+  if(chunkByteCounts_.size()/planes<chunksPerPlane&&compression_!=COMPRESSION_NONE){
+    fail("the TIFF image is missing strip or tile sizes");
+  }
+  cachedChunk_=-1;
+}
+
+/**
+ * Decodes a strip or tile into host ordered samples, keeping the last one in case the next band needs it again.
+ * @return a pointer to chunkRows rows of decoded samples.
+ */
+const uint8_t *TiffImage::decodeChunk(const int chunk, const int chunkRows){
+  if(chunk==cachedChunk_){
+    return cachedData_;
+  }
+  const int samples=planar_?1:samplesPerPixel_;
+  const int sampleBytes=bitsPerSample_/8;
+  //readDirectory() made sure that a whole strip or tile fits in a size_t
+  const size_t rowBytes=(size_t)chunkWidth_*samples*sampleBytes;
+  const size_t expected=rowBytes*chunkRows;
+  const bool swap=sampleBytes>1&&bigEndian_!=hostBigEndian();
+
+  const uint8_t *data;
+  if(compression_==COMPRESSION_NONE){
+    data=bytes(chunkOffsets_[chunk],expected,raw_);
+    if(swap||predictor_==2){
+      decoded_.assign(data,data+expected);
+      data=&decoded_[0];
+    }
+  }else{
+    const uint8_t *in=bytes(chunkOffsets_[chunk],(size_t)chunkByteCounts_[chunk],raw_);
+    decoded_.assign(expected,0);
+    switch(compression_){
+    case COMPRESSION_LZW: decodeLzw(in,(size_t)chunkByteCounts_[chunk],&decoded_[0],expected); break;
+    case COMPRESSION_PACKBITS: decodePackBits(in,(size_t)chunkByteCounts_[chunk],&decoded_[0],expected); break;
+    default: decodeDeflate(in,(size_t)chunkByteCounts_[chunk],&decoded_[0],expected); break;
+    }
+    data=&decoded_[0];
+  }
+
+  if(swap){
+    swapBytes(&decoded_[0],expected,sampleBytes);
+  }
+  if(predictor_==2){
+    const size_t rowSamples=(size_t)chunkWidth_*samples;
+    switch(bitsPerSample_){
+    case 8: undoDifferencing<uint8_t>(&decoded_[0],chunkRows,rowBytes,rowSamples,samples); break;
+    case 16: undoDifferencing<uint16_t>(&decoded_[0],chunkRows,rowBytes,rowSamples,samples); break;
+    default: undoDifferencing<uint32_t>(&decoded_[0],chunkRows,rowBytes,rowSamples,samples); break;
+    }
+  }
+
+  cachedChunk_=chunk;
+  cachedData_=data;
+  return data;
+}
+
+void TiffImage::sumChannels(const int firstRow, const int rows, double *out){
+  if(firstRow<0||rows<0||firstRow+rows>height_){
+    fail("rows out of the TIFF image");
+  }
+  std::fill(out,out+(size_t)rows*width_,0.0);
+
+  const int across=(width_+chunkWidth_-1)/chunkWidth_;
+  const int down=(height_+chunkHeight_-1)/chunkHeight_;
+  const int samples=planar_?1:samplesPerPixel_;
+  const int channels=planar_?1:channels_;
+  const int planes=planar_?channels_:1;
+  const size_t rowBytes=(size_t)chunkWidth_*samples*(bitsPerSample_/8);
+  const double scale=sampleFormat_==SAMPLE_FORMAT_FLOAT?1:1/(pow(2.0,bitsPerSample_)-1);
+
+  for(int plane=0;plane<planes;plane++){
+    for(int chunkRow=firstRow/chunkHeight_;chunkRow<down&&chunkRow*chunkHeight_<firstRow+rows;chunkRow++){
+      const int top=chunkRow*chunkHeight_;
+      const int chunkRows=tiled_?chunkHeight_:std::min(chunkHeight_,height_-top);
+      const int from=std::max(firstRow,top);
+      const int to=std::min(firstRow+rows,std::min(top+chunkRows,height_));
+      for(int chunkColumn=0;chunkColumn<across;chunkColumn++){
+        const int chunk=(plane*down+chunkRow)*across+chunkColumn;
+        const uint8_t *data=decodeChunk(chunk,chunkRows);
+        const int left=chunkColumn*chunkWidth_;
+        const int cols=std::min(chunkWidth_,width_-left);
+        for(int r=from;r<to;r++){
+          const uint8_t *row=data+(size_t)(r-top)*rowBytes;
+          double *target=out+(r-firstRow)+(size_t)left*rows;
+          if(sampleFormat_==SAMPLE_FORMAT_FLOAT){
+            if(bitsPerSample_==32) addRow<float>(row,cols,samples,channels,scale,target,rows);
+            else addRow<double>(row,cols,samples,channels,scale,target,rows);
+          }else{
+            if(bitsPerSample_==8) addRow<uint8_t>(row,cols,samples,channels,scale,target,rows);
+            else if(bitsPerSample_==16) addRow<uint16_t>(row,cols,samples,channels,scale,target,rows);
+            else addRow<uint32_t>(row,cols,samples,channels,scale,target,rows);
+          }
+        }
+      }
+    }
+  }
+}
+
+double normalizeIntensities(double *values, const size_t size){
+  double max=0;
+  for(size_t i=0;i<size;i++){
+    if(values[i]>max) max=values[i];
+  }
+  if(max>0){
+    for(size_t i=0;i<size;i++){
+      values[i]/=max;
+    }
+  }
+  return max;
+}
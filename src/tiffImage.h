@@ -0,0 +1,118 @@
+/**
+ * @file
+ * A small native TIFF reader, plain C++. It reads baseline grayscale and RGB(A) images with 8, 16 or 32 bit
+ * unsigned integer or 32/64 bit floating point samples, stored in strips or tiles, chunky or planar, either
+ * uncompressed or compressed with LZW, Deflate or PackBits (with or without horizontal differencing), from classic
+ * TIFF or BigTIFF files. Instead of handing out the samples, it sums the color channels of each pixel/dot (each
+ * scaled to [0,1] as tiff::readTIFF does) in a single streaming pass, straight into the intensity matrix the
+ * cluster search works on, either whole or in bands of rows. Multi-page files (such as z-stacks) are read one page
+ * at a time.
+ */
+#ifndef TIFF_IMAGE_H
+#define TIFF_IMAGE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+/**
+ * An open TIFF file. All the errors (unreadable, truncated or unsupported files) are reported by throwing
+ * std::runtime_error.
+ */
+class TiffImage {
+public:
+  /**
+   * Opens the file, finds all its pages and reads the description of the first one.
+   * @param path path to the file.
+   * @param mapped whether to memory-map the file (where the platform allows it). The samples of uncompressed
+   * images are then read right from the mapping, without any intermediate copy.
+   */
+  TiffImage(const std::string &path, const bool mapped);
+  ~TiffImage();
+
+  /**
+   * @return the number of pages (images) in the file.
+   */
+  int pages() const { return (int)pageOffsets_.size(); }
+  /**
+   * Reads the description of another page, which width(), height(), channels() and sumChannels() refer to from
+   * then on.
+   * @param page the 0-based number of the page.
+   */
+  void selectPage(const int page);
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+  /**
+   * @return the number of channels summed up into an intensity: 1 for grayscale, 3 for RGB images. Alpha and
+   * other extra samples are left out.
+   */
+  int channels() const { return channels_; }
+
+  /**
+   * Sums the channels of the pixels/dots in a band of rows.
+   * @param firstRow the first (0-based) row of the band.
+   * @param rows the number of rows in the band.
+   * @param out receives the sums as a column-major rows*width() matrix.
+   */
+  void sumChannels(const int firstRow, const int rows, double *out);
+  /**
+   * Sums the channels of all the pixels/dots.
+   * @param out receives the sums as a column-major height()*width() matrix.
+   */
+  void sumChannels(double *out) { sumChannels(0,height_,out); }
+
+private:
+  TiffImage(const TiffImage&);
+  TiffImage& operator=(const TiffImage&);
+
+  const uint8_t *bytes(const uint64_t offset, const size_t count, std::vector<uint8_t> &scratch) const;
+  uint16_t read16(const uint8_t *p) const;
+  uint32_t read32(const uint8_t *p) const;
+  uint64_t read64(const uint8_t *p) const;
+  void findPages(uint64_t offset);
+  void readDirectory(const uint64_t offset);
+  const uint8_t *decodeChunk(const int chunk, const int chunkRows);
+  void close();
+
+  FILE *file_;
+  const uint8_t *map_;
+  uint64_t size_;
+  bool bigEndian_;
+  bool bigTiff_;
+  std::vector<uint64_t> pageOffsets_;
+
+  int width_;
+  int height_;
+  int channels_;
+  int samplesPerPixel_;
+  int bitsPerSample_;
+  int sampleFormat_;
+  int compression_;
+  int predictor_;
+  bool planar_;
+  bool tiled_;
+  int chunkWidth_;
+  int chunkHeight_;
+  std::vector<uint64_t> chunkOffsets_;
+  std::vector<uint64_t> chunkByteCounts_;
+
+  int cachedChunk_;
+  const uint8_t *cachedData_;
+  std::vector<uint8_t> decoded_;
+  std::vector<uint8_t> raw_;
+};
+
+/**
+ * Rescales intensities to [0,1] by dividing them by their maximum. Left as they are if there are no positive
+ * intensities. (The former R-side scales::rescale(x,c(0,max(x)),c(0,1)) had its ranges swapped and multiplied by
+ * the maximum instead.)
+ * @param values the intensities.
+ * @param size the number of intensities.
+ * @return the maximum the intensities were divided by.
+ */
+double normalizeIntensities(double *values, const size_t size);
+
+#endif
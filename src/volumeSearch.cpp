@@ -0,0 +1,313 @@
+#include <stdlib.h>
+#include <limits.h>
+#include <stdexcept>
+
+#include "volumeSearch.h"
+#include "workerPool.h"
+
+/**
+ * Number of seeds that may grow their clusters concurrently in a round, per thread, see clusterSearch.cpp.
+ */
+static const int WINNERS_PER_THREAD=16;
+
+/**
+ * Upper bound on the number of seeds a round looks at, per seed that may grow, see clusterSearch.cpp.
+ */
+static const int SEEDS_PER_WINNER=64;
+
+VoxelField::VoxelField(const double *intensities, const int nrow, const int ncol, const int nslice,
+                       const double cutoff)
+  :intensities_(intensities),nrow_(nrow),ncol_(ncol),nslice_(nslice),stride_(nrow+2),planeStride_(0){
+  if((double)(nrow+2)*(ncol+2)*(nslice+2)>INT_MAX){
+    throw std::runtime_error("the stack has too many voxels, search it in parts");
+  }
+  planeStride_=stride_*(ncol+2);
+  const size_t words=((size_t)planeStride_*(nslice+2)+63)/64;
+  brightBits_.assign(words,0);
+  visitedBits_.assign(words,0);
+  for(int z=1;z<=nslice;z++){
+    for(int y=1;y<=ncol;y++){
+      const double *column=intensities+((size_t)(z-1)*ncol+(y-1))*nrow;
+      for(int x=1;x<=nrow;x++){
+        const double intensity=column[x-1];
+        if(intensity>0&&intensity>=cutoff){
+          const int i=index(x,y,z);
+          brightBits_[i>>6]|=(uint64_t)1<<(i&63);
+        }
+      }
+    }
+  }
+}
+
+/**
+ * @return the largest number of steps of the given length (along one axis) closeEnoughSquared() accepts, -1 if it
+ * accepts none.
+ */
+static int axisReach(const double step, const double width, const double var){
+  int reach=-1;
+  while(reach<(1<<14)&&closeEnoughSquared((reach+1)*step*(reach+1)*step,width,var)){
+    reach++;
+  }
+  return reach;
+}
+
+BallAcceptance::BallAcceptance(const VolumeParams &params){
+  const int rx=axisReach(1,params.width,params.var);
+  const int rz=params.zScale>0?axisReach(params.zScale,params.width,params.var):rx;
+  reach=std::max(rx,0)+1;
+  reachZ=std::max(rz,0)+1;
+  side=2*reach+1;
+  planeSide=side*side;
+  centre=reach+reach*side+reachZ*planeSide;
+  mask.assign((size_t)planeSide*(2*reachZ+1),0);
+  for(int dz=-reachZ;dz<=reachZ;dz++){
+    for(int dy=-reach;dy<=reach;dy++){
+      for(int dx=-reach;dx<=reach;dx++){
+        const double z=dz*params.zScale;
+        mask[centre+dx+dy*side+dz*planeSide]=closeEnoughSquared((double)dx*dx+(double)dy*dy+z*z,params.width,
+                                                                 params.var);
+      }
+    }
+  }
+}
+
+/**
+ * Claims voxels by marking them visited in the field.
+ */
+struct VoxelClaims {
+  VoxelField &field;
+  VoxelClaims(VoxelField &field):field(field){}
+  bool available(const int index) const { return field.available(index); }
+  void claim(const int index) { field.setVisited(index); }
+};
+
+/**
+ * Claims voxels with atomic updates, see SharedVisitedClaims.
+ */
+struct SharedVoxelClaims {
+  VoxelField &field;
+  SharedVoxelClaims(VoxelField &field):field(field){}
+  bool available(const int index) const { return field.availableShared(index); }
+  void claim(const int index) { field.setVisitedShared(index); }
+};
+
+template<int Connectivity>
+static void findVolumeClustersSerial(VoxelField &field, const int *seeds, const size_t seedCount,
+                                     const VolumeParams &params, const BallAcceptance &ball,
+                                     VolumeClusterSet &clusters){
+  VoxelClaims claims(field);
+  std::vector<VolumeFrame> stack;
+  std::vector<int> output;
+  VolumeSummary summary;
+  VolumeSummary *summaryOut=clusters.summarize?&summary:0;
+  for(size_t i=0;i<seedCount;i++){
+    const int seed=field.fieldIndex(seeds[i]);
+    if(!field.visited(seed)){
+      growVolumeCluster<Connectivity>(field,claims,ball,seed,stack,output,summaryOut);
+      if(params.acceptable(output.size())){
+        clusters.add(&output[0],&output[0]+output.size(),summary);
+      }
+    }
+  }
+}
+
+/**
+ * A seed taken into a round of the parallel search.
+ */
+struct PendingVoxel {
+  int rank;
+  int pos;
+  int x;
+  int y;
+  int z;
+  PendingVoxel(const int rank, const int pos, const int x, const int y, const int z)
+    :rank(rank),pos(pos),x(x),y(y),z(z){}
+};
+
+/**
+ * A grown cluster of acceptable size, waiting to be put in seed order.
+ */
+struct FoundVolume {
+  int rank;
+  size_t offset;
+  size_t size;
+  VolumeSummary summary;
+  FoundVolume(const int rank, const size_t offset, const size_t size, const VolumeSummary &summary)
+    :rank(rank),offset(offset),size(size),summary(summary){}
+  bool operator<(const FoundVolume &other) const { return rank<other.rank; }
+};
+
+/**
+ * Block grid of the seeds taken into the current round, see RoundTiles. The blocks are two halos (the reach of
+ * the ball) wide along each axis, so the seeds a seed may interfere with all lie in the 3x3x3 blocks around it.
+ */
+class RoundBlocks {
+public:
+  RoundBlocks(const int nrow, const int ncol, const int nslice, const int side, const int sideZ)
+    :side_(side),sideZ_(sideZ),blocksX_(nrow/side+1),blocksY_(ncol/side+1),blocksZ_(nslice/sideZ+1),
+     heads_((size_t)blocksX_*blocksY_*blocksZ_,-1){}
+
+  /**
+   * Adds a seed to its block.
+   * @return true if no seed added before it lies within a block side of it along every axis.
+   */
+  bool add(const std::vector<PendingVoxel> &round, const int entry){
+    const PendingVoxel &seed=round[entry];
+    const int bx=seed.x/side_;
+    const int by=seed.y/side_;
+    const int bz=seed.z/sideZ_;
+    bool clear=true;
+    for(int k=std::max(0,bz-1);clear&&k<=std::min(blocksZ_-1,bz+1);k++){
+      for(int j=std::max(0,by-1);clear&&j<=std::min(blocksY_-1,by+1);j++){
+        for(int i=std::max(0,bx-1);clear&&i<=std::min(blocksX_-1,bx+1);i++){
+          for(int e=heads_[block(i,j,k)];e!=-1;e=next_[e]){
+            if(abs(round[e].x-seed.x)<=side_&&abs(round[e].y-seed.y)<=side_&&abs(round[e].z-seed.z)<=sideZ_){
+              clear=false;
+              break;
+            }
+          }
+        }
+      }
+    }
+    const size_t b=block(bx,by,bz);
+    if(heads_[b]==-1){
+      touched_.push_back(b);
+    }
+    next_.push_back(heads_[b]);
+    heads_[b]=entry;
+    return clear;
+  }
+
+  /**
+   * Empties all the blocks for the next round.
+   */
+  void clear(){
+    for(size_t i=0;i<touched_.size();i++){
+      heads_[touched_[i]]=-1;
+    }
+    touched_.clear();
+    next_.clear();
+  }
+
+private:
+  size_t block(const int i, const int j, const int k) const { return i+((size_t)k*blocksY_+j)*blocksX_; }
+
+  int side_;
+  int sideZ_;
+  int blocksX_;
+  int blocksY_;
+  int blocksZ_;
+  std::vector<int> heads_;
+  std::vector<int> next_;
+  std::vector<size_t> touched_;
+};
+
+template<int Connectivity>
+static void findVolumeClustersParallel(VoxelField &field, const int *seeds, const size_t seedCount,
+                                       const VolumeParams &params, const BallAcceptance &ball, const int threads,
+                                       VolumeClusterSet &clusters){
+  WorkerPool pool(threads);
+  const size_t maxWinners=(size_t)pool.size()*WINNERS_PER_THREAD;
+  const size_t maxRound=maxWinners*SEEDS_PER_WINNER;
+  RoundBlocks blocks(field.nrow(),field.ncol(),field.nslice(),2*ball.reach,2*ball.reachZ);
+
+  std::vector<PendingVoxel> round;
+  std::vector<PendingVoxel> waiting;
+  std::vector<int> winners;
+  std::vector<std::vector<int> > grown;
+  std::vector<VolumeSummary> summaries;
+  std::vector<std::vector<VolumeFrame> > stacks(pool.size());
+  std::vector<int> found;
+  std::vector<FoundVolume> foundClusters;
+
+  const WorkerPool::Task grow=[&](const int worker, const int i){
+    SharedVoxelClaims claims(field);
+    growVolumeCluster<Connectivity>(field,claims,ball,round[winners[i]].pos,stacks[worker],grown[i],
+                                    clusters.summarize?&summaries[i]:0);
+  };
+
+  size_t next=0;
+  while(next<seedCount||!waiting.empty()){
+    round.clear();
+    winners.clear();
+    for(size_t i=0;i<waiting.size();i++){
+      if(!field.visited(waiting[i].pos)){
+        round.push_back(waiting[i]);
+        if(blocks.add(round,round.size()-1)){
+          winners.push_back(round.size()-1);
+        }
+      }
+    }
+    while(next<seedCount&&winners.size()<maxWinners&&round.size()<maxRound){
+      const int pos=field.fieldIndex(seeds[next]);
+      if(!field.visited(pos)){
+        round.push_back(PendingVoxel(next,pos,field.x(pos),field.y(pos),field.z(pos)));
+        if(blocks.add(round,round.size()-1)){
+          winners.push_back(round.size()-1);
+        }
+      }
+      next++;
+    }
+    blocks.clear();
+
+    if(grown.size()<winners.size()){
+      grown.resize(winners.size());
+      summaries.resize(winners.size());
+    }
+    pool.run(winners.size(),grow);
+
+    waiting.clear();
+    size_t w=0;
+    for(size_t i=0;i<round.size();i++){
+      if(w<winners.size()&&winners[w]==(int)i){
+        const std::vector<int> &cluster=grown[w];
+        if(params.acceptable(cluster.size())){
+          foundClusters.push_back(FoundVolume(round[i].rank,found.size(),cluster.size(),summaries[w]));
+          if(clusters.keepPixels){
+            found.insert(found.end(),cluster.begin(),cluster.end());
+          }
+        }
+        w++;
+      }else{
+        waiting.push_back(round[i]);
+      }
+    }
+  }
+
+  std::sort(foundClusters.begin(),foundClusters.end());
+  clusters.pixels.reserve(clusters.pixels.size()+found.size());
+  for(size_t i=0;i<foundClusters.size();i++){
+    if(clusters.keepPixels){
+      const int *begin=&found[0]+foundClusters[i].offset;
+      clusters.add(begin,begin+foundClusters[i].size,foundClusters[i].summary);
+    }else{
+      clusters.add(foundClusters[i].size,foundClusters[i].summary);
+    }
+  }
+}
+
+template<int Connectivity>
+static void searchVolume(VoxelField &field, const int *seeds, const size_t seedCount, const VolumeParams &params,
+                         const int threads, VolumeClusterSet &clusters){
+  const BallAcceptance ball(params);
+  if(resolveThreads(threads)>1){
+    findVolumeClustersParallel<Connectivity>(field,seeds,seedCount,params,ball,threads,clusters);
+  }else{
+    findVolumeClustersSerial<Connectivity>(field,seeds,seedCount,params,ball,clusters);
+  }
+}
+
+void findVolumeClusters(VoxelField &field, const int *seeds, const size_t seedCount, const VolumeParams &params,
+                        const int threads, VolumeClusterSet &clusters){
+  if(params.connectivity==26){
+    searchVolume<26>(field,seeds,seedCount,params,threads,clusters);
+  }else{
+    searchVolume<6>(field,seeds,seedCount,params,threads,clusters);
+  }
+}
+
+void toImageIndices(const VoxelField &field, VolumeClusterSet &clusters){
+  for(size_t i=0;i<clusters.pixels.size();i++){
+    clusters.pixels[i]=field.imageIndex(clusters.pixels[i]);
+  }
+}
@@ -0,0 +1,316 @@
+/**
+ * @file
+ * Cluster search over a z-stack, plain C++: the volumetric counterpart of PixelField, growCluster() and
+ * findClusters(). The stack is a column-major nrow*ncol*nslice array of voxel intensities (slice after slice),
+ * voxels are addressed by their 1-based (x,y,z) coordinates, x being the row, y the column and z the slice, or by a
+ * linear index into a padded field. Clusters grow from the brightest voxels to their 6 face neighbors, or to all
+ * 26 neighbors (faces, edges and corners), within a ball around the seed: the spherical analogue of closeEnough(),
+ * with the slices zScale pixels/dots apart, as confocal stacks are usually sampled more coarsely along z.
+ */
+#ifndef VOLUME_SEARCH_H
+#define VOLUME_SEARCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include <vector>
+
+#include "clusterSearch.h"
+
+/**
+ * The bright and visited masks of a z-stack, as PixelField holds them for an image. The masks are padded with a
+ * one voxel wide border on all six sides that is never bright, so a 1-based coordinate (x,y,z) maps to the linear
+ * index x+y*stride()+z*planeStride().
+ */
+class VoxelField {
+public:
+  /**
+   * @param intensities column-major stack intensities, nrow*ncol*nslice values, kept (not copied) for the
+   * cluster summaries, so they must outlive the field.
+   * @param nrow number of rows in a slice.
+   * @param ncol number of columns in a slice.
+   * @param nslice number of slices.
+   * @param cutoff background intensity cutoff, see PixelField.
+   * @throws std::runtime_error if the padded stack has too many voxels to be indexed by an int.
+   */
+  VoxelField(const double *intensities, const int nrow, const int ncol, const int nslice, const double cutoff);
+
+  int nrow() const { return nrow_; }
+  int ncol() const { return ncol_; }
+  int nslice() const { return nslice_; }
+  /**
+   * @return the distance between voxels adjacent along y in the linear index (number of padded rows).
+   */
+  int stride() const { return stride_; }
+  /**
+   * @return the distance between voxels adjacent along z in the linear index (number of voxels in a padded
+   * slice).
+   */
+  int planeStride() const { return planeStride_; }
+
+  int index(const int x, const int y, const int z) const { return x+y*stride_+z*planeStride_; }
+  /**
+   * @param imageIndex 0-based column-major index of a voxel in the unpadded stack.
+   * @return the linear field index of the same voxel.
+   */
+  int fieldIndex(const int imageIndex) const {
+    const int plane=nrow_*ncol_;
+    const int inPlane=imageIndex%plane;
+    return index(inPlane%nrow_+1,inPlane/nrow_+1,imageIndex/plane+1);
+  }
+  /**
+   * @param index a linear field index (not on the border).
+   * @return 0-based column-major index of the same voxel in the unpadded stack.
+   */
+  int imageIndex(const int index) const {
+    return (x(index)-1)+(y(index)-1)*nrow_+(z(index)-1)*nrow_*ncol_;
+  }
+  int x(const int index) const { return index%stride_; }
+  int y(const int index) const { return index%planeStride_/stride_; }
+  int z(const int index) const { return index/planeStride_; }
+  const double *intensities() const { return intensities_; }
+
+  bool bright(const int index) const { return testBit(brightBits_,index); }
+  bool visited(const int index) const { return testBit(visitedBits_,index); }
+  bool available(const int index) const {
+    const int word=index>>6;
+    const uint64_t bit=(uint64_t)1<<(index&63);
+    return (brightBits_[word]&~visitedBits_[word]&bit)!=0;
+  }
+  void setVisited(const int index) { visitedBits_[index>>6]|=(uint64_t)1<<(index&63); }
+  /**
+   * Same as available(), but safe to call while other threads mark voxels visited (see setVisitedShared()).
+   */
+  bool availableShared(const int index) const {
+    const int word=index>>6;
+    const uint64_t bit=(uint64_t)1<<(index&63);
+    return (brightBits_[word]&~__atomic_load_n(&visitedBits_[word],__ATOMIC_RELAXED)&bit)!=0;
+  }
+  /**
+   * Marks the voxel as visited with an atomic update of its mask word (see PixelField::setVisitedShared()).
+   */
+  void setVisitedShared(const int index) {
+    __atomic_fetch_or(&visitedBits_[index>>6],(uint64_t)1<<(index&63),__ATOMIC_RELAXED);
+  }
+
+private:
+  static bool testBit(const std::vector<uint64_t> &bits, const int index) {
+    return ((bits[index>>6]>>(index&63))&1)!=0;
+  }
+
+  const double *intensities_;
+  int nrow_;
+  int ncol_;
+  int nslice_;
+  int stride_;
+  int planeStride_;
+  std::vector<uint64_t> brightBits_;
+  std::vector<uint64_t> visitedBits_;
+};
+
+/**
+ * A frame of the explicit expansion stack, see ExpansionFrame.
+ */
+struct VolumeFrame {
+  int pos;
+  int dx;
+  int dy;
+  int dz;
+  int direction;
+  VolumeFrame(const int pos, const int dx, const int dy, const int dz):pos(pos),dx(dx),dy(dy),dz(dz),direction(0){}
+};
+
+/**
+ * Sufficient statistics of a cluster of voxels, see ClusterSummary.
+ */
+struct VolumeSummary {
+  int x;
+  int y;
+  int z;
+  int volume;
+  long long sumDx;
+  long long sumDy;
+  long long sumDz;
+  double sumIntensity;
+  double peakIntensity;
+
+  VolumeSummary():x(0),y(0),z(0),volume(0),sumDx(0),sumDy(0),sumDz(0),sumIntensity(0),peakIntensity(0){}
+
+  void start(const int seedX, const int seedY, const int seedZ, const double intensity) {
+    x=seedX;
+    y=seedY;
+    z=seedZ;
+    volume=1;
+    sumDx=0;
+    sumDy=0;
+    sumDz=0;
+    sumIntensity=intensity;
+    peakIntensity=intensity;
+  }
+  void add(const int dx, const int dy, const int dz, const double intensity) {
+    volume++;
+    sumDx+=dx;
+    sumDy+=dy;
+    sumDz+=dz;
+    sumIntensity+=intensity;
+    if(intensity>peakIntensity) peakIntensity=intensity;
+  }
+  double centreX() const { return x+(double)sumDx/volume; }
+  double centreY() const { return y+(double)sumDy/volume; }
+  double centreZ() const { return z+(double)sumDz/volume; }
+  double meanIntensity() const { return sumIntensity/volume; }
+};
+
+typedef BasicClusterSet<VolumeSummary> VolumeClusterSet;
+
+/**
+ * Parameters of a z-stack search, as given to get.clusters.volume(). The sizes are numbers of voxels, the
+ * distances are measured in pixels/dots, the slices being zScale pixels/dots apart.
+ */
+struct VolumeParams {
+  double cutoff;
+  /**
+   * a diameter of a cluster (cell).
+   */
+  double width;
+  /**
+   * variance value, which rougly estimates how much the cells may vary in diameter.
+   */
+  double var;
+  /**
+   * is used if its value is lower than the volume implied by width-var, see ClusterParams::minArea.
+   */
+  double minVolume;
+  /**
+   * the distance between two slices, in pixels/dots.
+   */
+  double zScale;
+  /**
+   * 6 or 26, the number of neighbors a cluster grows to around each of its voxels.
+   */
+  int connectivity;
+
+  VolumeParams(const double cutoff, const double width, const double var, const double minVolume,
+               const double zScale, const int connectivity)
+    :cutoff(cutoff),width(width),var(var),minVolume(minVolume),zScale(zScale),connectivity(connectivity){}
+
+  /**
+   * @return the number of voxels in a ball of the given diameter, with pi taken as 3 as ClusterParams::area() does.
+   */
+  double ballVolume(const double diameter) const { return 4*pow(diameter/2,3)/zScale; }
+  double minClusterSize() const {
+    const double lowMargin=ballVolume(width-var);
+    return lowMargin>minVolume?minVolume:lowMargin;
+  }
+  double maxClusterSize() const { return ballVolume(width+var); }
+  bool acceptable(const size_t size) const { return size<=maxClusterSize()&&size>=minClusterSize(); }
+};
+
+/**
+ * Whether a voxel is close enough to the seed to join its cluster: closeEnoughSquared() of its distance from the
+ * seed, looked up in a precomputed mask of the offsets. The mask is large enough for every offset the expansion
+ * can probe (one voxel beyond the ball in each direction), so it needs no bounds checks.
+ */
+struct BallAcceptance {
+  /**
+   * the largest offset along x (and y) the expansion may probe.
+   */
+  int reach;
+  /**
+   * the largest offset along z the expansion may probe.
+   */
+  int reachZ;
+  int side;
+  int planeSide;
+  int centre;
+  std::vector<uint8_t> mask;
+  BallAcceptance(const VolumeParams &params);
+  bool accept(const int dx, const int dy, const int dz) const {
+    return mask[centre+dx+dy*side+dz*planeSide]!=0;
+  }
+};
+
+/**
+ * Neighbor offsets in the order the expansion probes them: the 6 faces (right, up, left, down as in 2-D, then the
+ * next and the previous slice), which is all of them for 6-connectivity, then the 12 edges and the 8 corners for
+ * 26-connectivity.
+ */
+static const int VOLUME_NEIGHBOR_DX[26]={1,0,-1,0,0,0, 1,-1,-1,1,1,-1,0,0,1,-1,0,0, 1,-1,-1,1,1,-1,-1,1};
+static const int VOLUME_NEIGHBOR_DY[26]={0,1,0,-1,0,0, 1,1,-1,-1,0,0,1,-1,0,0,1,-1, 1,1,-1,-1,1,1,-1,-1};
+static const int VOLUME_NEIGHBOR_DZ[26]={0,0,0,0,1,-1, 0,0,0,0,1,1,1,1,-1,-1,-1,-1, 1,1,1,1,-1,-1,-1,-1};
+
+/**
+ * Grows a single cluster of voxels from a seed, the way growCluster() grows one of pixels/dots.
+ * @tparam Connectivity 6 or 26.
+ * @tparam Claims see growCluster().
+ * @param field the stack field.
+ * @param claims the claims of the voxels.
+ * @param ball the acceptance test.
+ * @param seed field index of the starting voxel, must be free.
+ * @param stack a reusable work stack, cleared on entry.
+ * @param output a reusable vector, cleared on entry and filled with the field indices of the cluster voxels in
+ * the order they were accepted.
+ * @param summary if not null, receives the statistics of the cluster.
+ */
+template<int Connectivity, class Claims>
+void growVolumeCluster(const VoxelField &field, Claims &claims, const BallAcceptance &ball, const int seed,
+                       std::vector<VolumeFrame> &stack, std::vector<int> &output, VolumeSummary *summary){
+  int step[Connectivity];
+  for(int d=0;d<Connectivity;d++){
+    step[d]=VOLUME_NEIGHBOR_DX[d]+VOLUME_NEIGHBOR_DY[d]*field.stride()+VOLUME_NEIGHBOR_DZ[d]*field.planeStride();
+  }
+  const double *seedIntensity=field.intensities()+field.imageIndex(seed);
+  const ptrdiff_t nrow=field.nrow();
+  const ptrdiff_t plane=nrow*field.ncol();
+
+  stack.clear();
+  output.clear();
+
+  claims.claim(seed);
+  if(summary) summary->start(field.x(seed),field.y(seed),field.z(seed),*seedIntensity);
+  output.push_back(seed);
+  stack.push_back(VolumeFrame(seed,0,0,0));
+
+  while(!stack.empty()){
+    VolumeFrame &top=stack.back();
+    if(top.direction==Connectivity){
+      stack.pop_back();
+      continue;
+    }
+    const int direction=top.direction++;
+    const int pos=top.pos+step[direction];
+    const int dx=top.dx+VOLUME_NEIGHBOR_DX[direction];
+    const int dy=top.dy+VOLUME_NEIGHBOR_DY[direction];
+    const int dz=top.dz+VOLUME_NEIGHBOR_DZ[direction];
+    if(claims.available(pos)&&ball.accept(dx,dy,dz)){
+      claims.claim(pos);
+      output.push_back(pos);
+      if(summary) summary->add(dx,dy,dz,seedIntensity[dx+dy*nrow+dz*plane]);
+      stack.push_back(VolumeFrame(pos,dx,dy,dz));
+    }
+  }
+}
+
+/**
+ * Grows clusters from the seeds in order and collects those of acceptable size, as findClusters() does for an
+ * image, with the same deterministic rounds when running on several threads: the stack is cut into blocks of two
+ * halos along each axis (the halo along z counted in slices), and a seed grows concurrently with the others of its
+ * round only if no earlier seed of the round lies within two halos of it along every axis, so clusters in
+ * different slabs of slices as well as side by side in the same slab grow at the same time. The
+ * clusters are identical to (and reported in the same order as) those of the serial search.
+ * @param field the stack field.
+ * @param seeds 0-based column-major stack indices of the seeds, sorted by intensity descending (see sortSeeds()).
+ * @param seedCount the number of seeds.
+ * @param params search parameters.
+ * @param threads the number of threads to use, values below 1 mean as many as there are hardware threads.
+ * @param clusters receives the clusters (and their summaries, if it is set to summarize).
+ */
+void findVolumeClusters(VoxelField &field, const int *seeds, const size_t seedCount, const VolumeParams &params,
+                        const int threads, VolumeClusterSet &clusters);
+
+/**
+ * Converts the voxels of the clusters from field indices to 0-based column-major stack indices.
+ */
+void toImageIndices(const VoxelField &field, VolumeClusterSet &clusters);
+
+#endif
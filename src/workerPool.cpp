@@ -0,0 +1,96 @@
+#include "workerPool.h"
+
+int resolveThreads(const int threads){
+  if(threads>0){
+    return threads;
+  }
+  const int hardware=(int)std::thread::hardware_concurrency();
+  return hardware>0?hardware:1;
+}
+
+WorkerPool::WorkerPool(int threads)
+  :task_(0),items_(0),next_(0),pending_(0),generation_(0),stop_(false){
+  threads=resolveThreads(threads);
+  for(int w=1;w<threads;w++){
+    threads_.push_back(std::thread(&WorkerPool::work,this,w));
+  }
+}
+
+WorkerPool::~WorkerPool(){
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_=true;
+  }
+  wake_.notify_all();
+  for(size_t w=0;w<threads_.size();w++){
+    threads_[w].join();
+  }
+}
+
+void WorkerPool::run(const int items, const Task &task){
+  if(threads_.empty()||items<2){
+    for(int i=0;i<items;i++){
+      task(0,i);
+    }
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task_=&task;
+    items_=items;
+    next_=0;
+    pending_=(int)threads_.size();
+    generation_++;
+  }
+  wake_.notify_all();
+  drain(0);
+  std::exception_ptr error;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while(pending_>0){
+      done_.wait(lock);
+    }
+    task_=0;
+    error.swap(error_);
+  }
+  if(error){
+    std::rethrow_exception(error);
+  }
+}
+
+void WorkerPool::drain(const int worker){
+  try{
+    for(int i=next_++;i<items_;i=next_++){
+      (*task_)(worker,i);
+    }
+  }catch(...){
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(!error_){
+      error_=std::current_exception();
+    }
+    next_=items_;
+  }
+}
+
+void WorkerPool::work(const int worker){
+  unsigned long seen=0;
+  for(;;){
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while(!stop_&&generation_==seen){
+        wake_.wait(lock);
+      }
+      if(stop_){
+        return;
+      }
+      seen=generation_;
+    }
+    drain(worker);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if(--pending_==0){
+        done_.notify_one();
+      }
+    }
+  }
+}
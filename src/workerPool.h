@@ -0,0 +1,77 @@
+/**
+ * @file
+ * A small persistent thread pool used by the parallel parts of the package. Plain C++, the tasks must not
+ * touch any R objects.
+ */
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <functional>
+
+/**
+ * Runs batches of independent work items on a fixed set of threads. The calling thread takes part in every
+ * batch as worker 0, so a pool of size 1 spawns no threads at all. Items are handed out one at a time from a
+ * shared counter, so a worker that is done with a cheap item immediately picks up the next one.
+ */
+class WorkerPool {
+public:
+  /**
+   * A unit of work: receives the index of the worker (in [0,size())) that runs it and the index of the item.
+   */
+  typedef std::function<void(int,int)> Task;
+
+  /**
+   * @param threads the number of workers including the calling thread, values below 1 mean as many as
+   * there are hardware threads.
+   */
+  explicit WorkerPool(int threads);
+  ~WorkerPool();
+
+  /**
+   * @return the number of workers, including the calling thread.
+   */
+  int size() const { return (int)threads_.size()+1; }
+
+  /**
+   * Runs task for every item in [0,items) and blocks until all of them are done. If a task throws, no more items
+   * are handed out, and once the items already running are done, the first exception is rethrown on the calling
+   * thread (where R can report it), rather than terminating the process from a worker.
+   */
+  void run(const int items, const Task &task);
+
+private:
+  WorkerPool(const WorkerPool&);
+  WorkerPool& operator=(const WorkerPool&);
+
+  void work(const int worker);
+  void drain(const int worker);
+
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  const Task *task_;
+  int items_;
+  std::atomic<int> next_;
+  int pending_;
+  unsigned long generation_;
+  bool stop_;
+  /**
+   * the first exception thrown by a task of the current batch.
+   */
+  std::exception_ptr error_;
+};
+
+/**
+ * @param threads requested number of threads, values below 1 mean as many as there are hardware threads.
+ * @return the number of threads to actually use.
+ */
+int resolveThreads(const int threads);
+
+#endif
@@ -0,0 +1,27 @@
+#include "getClusters.h"
+
+/**
+ * Rcpp export function, renders the overlay of clusters on their image (see renderOverlay()) and writes it as a
+ * PNG or TIFF file (see writeOverlay()).
+ * @param imgMtx an image intensity matrix.
+ * @param labelsMtx an integer label matrix of the same size, as returned by getClusters with the "labels" output.
+ * @param file path to the file to write, a TIFF if it ends with .tif or .tiff, a PNG otherwise.
+ * @param style the colours and markers (see readOverlayStyle()).
+ * @return the path of the file.
+ */
+// [[Rcpp::export]]
+RcppExport SEXP writeClusterOverlay(SEXP imgMtx, SEXP labelsMtx, SEXP file, SEXP style) {
+BEGIN_RCPP
+  const NumericMatrix img(imgMtx);
+  const IntegerMatrix labels(labelsMtx);
+  if(labels.nrow()!=img.nrow()||labels.ncol()!=img.ncol()){
+    stop("the labels must have the size of the image");
+  }
+  OverlayStyle overlayStyle;
+  readOverlayStyle(style, overlayStyle);
+  std::vector<uint8_t> rgb;
+  renderOverlay(img.begin(), img.nrow(), img.ncol(), labels.begin(), overlayStyle, rgb);
+  writeOverlay(as<std::string>(file), rgb, img.ncol(), img.nrow());
+  return file;
+END_RCPP
+}